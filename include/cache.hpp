@@ -0,0 +1,55 @@
+#ifndef PICOTOR_CACHE_HPP
+#define PICOTOR_CACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <storage.hpp>
+#include <torrent.hpp>
+
+using std::vector;
+
+// whole pieces read from disk for seeding. peers ask for the blocks of a piece one after another, so the first
+// request reads the whole piece and the rest are served from memory. least recently used pieces are evicted once
+// the cache is over its size. with zero-copy uploads the data is sent straight from the file instead, so the cache
+// only reads pieces ahead into the kernel's page cache and keeps track of which ones it has. only touched from the
+// io thread, except for the counters.
+class ReadCache {
+public:
+    ReadCache(const SingleFileTorrent& tor, Storage& storage, size_t capacity)
+        : tor_(tor), storage_(storage), capacity_(capacity) {}
+
+    // copy part of a piece into the end of a buffer, reading the piece in if it isn't cached; false if we can't
+    bool read(uint32_t piece, uint32_t offset, uint32_t length, vector<char>* out);
+    // a block of the piece is about to be sent from the file: read the whole piece ahead, if we haven't already
+    void prefetch(uint32_t piece);
+
+    [[nodiscard]] bool enabled() const { return capacity_ > 0; }
+    [[nodiscard]] uint64_t hits() const { return hits_; }
+    [[nodiscard]] uint64_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        uint32_t piece;
+        // empty for pieces that were only read ahead
+        vector<char> data;
+    };
+
+    // fetch a piece, most recently used first
+    const Entry* get(uint32_t piece);
+    const Entry* insert(uint32_t piece, vector<char> data);
+    void evict();
+
+    const SingleFileTorrent& tor_;
+    Storage& storage_;
+    const size_t capacity_;
+    size_t size_ = 0;
+    std::list<Entry> entries_;
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> index_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+};
+
+#endif //PICOTOR_CACHE_HPP
@@ -1,6 +1,8 @@
 #ifndef PICOTOR_COMMON_HPP
 #define PICOTOR_COMMON_HPP
 
+#include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <fstream>
 #include <iomanip>
@@ -65,8 +67,17 @@ namespace cmn {
         explicit Address(const char *bytes)
             : raw(ntohl(*reinterpret_cast<const uint32_t *>(bytes))),
               port(ntohs(*reinterpret_cast<const uint16_t *>(&bytes[4]))) {}
+        Address(uint32_t raw_, uint16_t port_): raw(raw_), port(port_) {}
 
         [[nodiscard]] string to_string() const { return ip() + ":" + port_str(); }
+        // the compact form trackers and peers send: address then port, big-endian
+        [[nodiscard]] string to_bytes() const {
+            const uint32_t raw_be = htonl(raw);
+            const uint16_t port_be = htons(port);
+            string bytes{reinterpret_cast<const char*>(&raw_be), sizeof(raw_be)};
+            bytes.append(reinterpret_cast<const char*>(&port_be), sizeof(port_be));
+            return bytes;
+        }
 
         [[nodiscard]] string ip() const;
         [[nodiscard]] string port_str() const;
@@ -83,27 +94,159 @@ namespace cmn {
         Address() = default;
     };
 
+    // set of piece indices, packed into 64-bit words in wire order: bit 0 is the most significant bit of the first
+    // word, as it is of the first byte of a Bitfield message. set operations work a word at a time
     class Bitfield {
     public:
+        Bitfield() = default;
+        explicit Bitfield(size_t bits): size_(bits), words_((bits + 63) / 64, 0) {}
+
         void copy_from(const vector<char>& vec) {
-            data_.clear();
-            data_.reserve(vec.size() * 8);
-            for (char c : vec) {
-                for (uint8_t i = 1 << 7; i > 0; i >>= 1) {
-                    data_.push_back(c & i);
-                }
+            size_ = vec.size() * 8;
+            words_.assign((vec.size() + 7) / 8, 0);
+            for (size_t i = 0; i < vec.size(); ++i) {
+                words_[i / 8] |= static_cast<uint64_t>(static_cast<uint8_t>(vec[i])) << (56 - 8 * (i % 8));
+            }
+        }
+
+        // the wire encoding, as sent in a Bitfield message
+        [[nodiscard]] vector<char> to_bytes() const {
+            vector<char> bytes((size_ + 7) / 8);
+            for (size_t i = 0; i < bytes.size(); ++i) {
+                bytes[i] = static_cast<char>(words_[i / 8] >> (56 - 8 * (i % 8)));
             }
+            return bytes;
         }
 
         [[nodiscard]] bool get(size_t index) const {
-            if (index >= data_.size()) return false;
-            return data_[index];
+            if (index >= size_) return false;
+            return words_[index / 64] & mask(index);
+        }
+
+        void set(size_t index) {
+            if (index >= size_) resize(index + 1);
+            words_[index / 64] |= mask(index);
+        }
+
+        void reset(size_t index) {
+            if (index < size_) words_[index / 64] &= ~mask(index);
         }
 
-        [[nodiscard]] size_t size() const { return data_.size(); }
+        void resize(size_t bits) {
+            size_ = bits;
+            words_.resize((bits + 63) / 64, 0);
+            // keep bits past the end clear, so whole-word operations can ignore them
+            if (bits % 64 != 0) words_.back() &= ~uint64_t{0} << (64 - bits % 64);
+        }
+
+        [[nodiscard]] size_t size() const { return size_; }
+        [[nodiscard]] size_t count() const {
+            size_t result = 0;
+            for (const auto word : words_) result += __builtin_popcountll(word);
+            return result;
+        }
+        [[nodiscard]] bool any() const {
+            return std::any_of(words_.begin(), words_.end(), [](auto word) { return word != 0; });
+        }
+
+        // this & rhs is non-empty: e.g. "does this peer have any piece we still want"
+        [[nodiscard]] bool any_and(const Bitfield& rhs) const {
+            const auto n = std::min(words_.size(), rhs.words_.size());
+            for (size_t i = 0; i < n; ++i) {
+                if (words_[i] & rhs.words_[i]) return true;
+            }
+            return false;
+        }
+
+        // |this & ~rhs|: e.g. "how many pieces does this peer have that we don't"
+        [[nodiscard]] size_t count_and_not(const Bitfield& rhs) const {
+            size_t result = 0;
+            for (size_t i = 0; i < words_.size(); ++i) {
+                result += __builtin_popcountll(words_[i] & ~rhs.word(i));
+            }
+            return result;
+        }
+
+        [[nodiscard]] bool any_and_not(const Bitfield& rhs) const {
+            for (size_t i = 0; i < words_.size(); ++i) {
+                if (words_[i] & ~rhs.word(i)) return true;
+            }
+            return false;
+        }
+
+        // first index >= from set in this, or size() if there is none
+        [[nodiscard]] size_t find_next(size_t from) const {
+            return find_next_with(from, [](size_t) { return ~uint64_t{0}; });
+        }
+        // first index >= from set in both this and rhs
+        [[nodiscard]] size_t find_next_and(const Bitfield& rhs, size_t from) const {
+            return find_next_with(from, [&rhs](size_t i) { return rhs.word(i); });
+        }
+        // first index >= from set in this but not in rhs
+        [[nodiscard]] size_t find_next_and_not(const Bitfield& rhs, size_t from) const {
+            return find_next_with(from, [&rhs](size_t i) { return ~rhs.word(i); });
+        }
+
+    private:
+        size_t size_ = 0;
+        vector<uint64_t> words_;
+
+        static uint64_t mask(size_t index) { return uint64_t{1} << (63 - index % 64); }
+        [[nodiscard]] uint64_t word(size_t i) const { return i < words_.size() ? words_[i] : 0; }
+
+        template<typename F>
+        [[nodiscard]] size_t find_next_with(size_t from, const F& filter) const {
+            if (from >= size_) return size_;
+            auto i = from / 64;
+            // ignore bits before `from` in the first word
+            auto bits = words_[i] & filter(i) & (~uint64_t{0} >> (from % 64));
+            while (bits == 0) {
+                if (++i >= words_.size()) return size_;
+                bits = words_[i] & filter(i);
+            }
+            return std::min(size_, i * 64 + __builtin_clzll(bits));
+        }
+    };
+}
+
+namespace cmn {
+    // exponentially-weighted transfer rate, in bytes per second
+    class RateMeter {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        void add(uint64_t bytes, Clock::time_point now = Clock::now()) {
+            update(now);
+            window_bytes_ += bytes;
+            total_ += bytes;
+        }
+
+        [[nodiscard]] double rate(Clock::time_point now = Clock::now()) {
+            update(now);
+            return rate_;
+        }
+
+        [[nodiscard]] uint64_t total() const { return total_; }
 
     private:
-        vector<bool> data_;
+        // fold in one sample per window; a sample counts for more the longer its window was
+        static constexpr std::chrono::seconds WINDOW{1};
+        static constexpr double HORIZON_SEC = 5;
+
+        Clock::time_point window_start_ = Clock::now();
+        uint64_t window_bytes_ = 0;
+        uint64_t total_ = 0;
+        double rate_ = 0;
+
+        void update(Clock::time_point now) {
+            const auto elapsed = now - window_start_;
+            if (elapsed < WINDOW) return;
+            const auto seconds = std::chrono::duration<double>(elapsed).count();
+            const auto weight = std::min(1.0, seconds / HORIZON_SEC);
+            rate_ = rate_ * (1 - weight) + (static_cast<double>(window_bytes_) / seconds) * weight;
+            window_start_ = now;
+            window_bytes_ = 0;
+        }
     };
 }
 
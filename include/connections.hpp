@@ -0,0 +1,130 @@
+#ifndef PICOTOR_CONNECTIONS_HPP
+#define PICOTOR_CONNECTIONS_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/asio.hpp>
+
+#include <common.hpp>
+#include <message.hpp>
+#include <peercache.hpp>
+#include <settings.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using std::shared_ptr;
+using cmn::Address;
+
+class Peer;
+
+// decides which peers to connect to and when. candidate addresses (from the peer cache, trackers, and later other
+// sources) are deduplicated, dialled a few at a time under caps on half-open and total connections, and retried with exponential
+// backoff when they fail or drop. when every slot is full, the slowest peer is periodically replaced by a fresh
+// candidate. only touched from the io thread, except for known().
+class ConnectionManager {
+public:
+    ConnectionManager(const TorrentContext& ctx, const Settings& settings);
+
+    void start();
+
+    // learn about possible peers; addresses we already know about are ignored
+    void add_candidates(const vector<Address>& addrs);
+    // a peer on our LAN: it's dialled before anyone else, and preferred when unchoking. peers that connect to us count
+    // as local if they're on one of our subnets, or at an address that announced itself by LSD
+    void add_local(const Address& addr);
+    [[nodiscard]] bool is_local(const Address& addr) const {
+        const auto candidate = candidates_.find(addr);
+        return candidate != candidates_.end() && candidate->second.local;
+    }
+
+    // take on a peer that connected to us and sent a valid handshake; false if there's no room for it
+    bool accept(ba::ip::tcp::socket socket, const Address& addr, Handshake handshake);
+
+    // called by peers as they progress
+    void on_connected(const Address& addr);
+    void on_closed(const Address& addr);
+
+    // a piece has been verified and written: update our have-set and every peer's interest, and queue a Have
+    // announcement for the next flush
+    void piece_completed(uint32_t index);
+    // the same for a piece a previous run left on disk
+    void piece_resumed(uint32_t index);
+
+    // some peer gave up blocks it had reserved; let the others pick them up straight away
+    void blocks_released();
+
+    [[nodiscard]] size_t connected() const { return connected_; }
+    [[nodiscard]] size_t half_open() const { return half_open_; }
+    // safe to read from other threads
+    [[nodiscard]] size_t known() const { return known_; }
+    // bytes of pieces downloaded and verified this session
+    [[nodiscard]] uint64_t downloaded() const { return downloaded_; }
+    // how many more peers we could connect to right now
+    [[nodiscard]] size_t spare() const {
+        return settings_.max_connections - std::min<size_t>(settings_.max_connections, connected_ + half_open_);
+    }
+    [[nodiscard]] const std::unordered_map<Address, shared_ptr<Peer>>& peers() const { return peers_; }
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    struct Candidate {
+        enum State { Idle, Connecting, Connected, Failed };
+
+        State state = Idle;
+        // peers that connected to us are forgotten when they leave, since we don't know their listening port
+        bool inbound = false;
+        bool local = false;
+        uint32_t failures = 0;
+        Clock::time_point connected_at;
+    };
+
+    const TorrentContext& ctx_;
+    const Settings& settings_;
+    const chrono::milliseconds TICK_INTERVAL = 250ms;
+
+    std::unordered_map<Address, Candidate> candidates_;
+    const vector<std::pair<uint32_t, uint32_t>> subnets_;
+    std::unordered_set<uint32_t> local_hosts_;
+    std::atomic<size_t> known_ = 0;
+    std::unordered_map<Address, shared_ptr<Peer>> peers_;
+    // candidates ready to dial, in the order we learnt about them
+    std::deque<Address> ready_;
+    // candidates waiting out a backoff, soonest first
+    typedef std::pair<Clock::time_point, Address> Retry;
+    struct RetryLater {
+        bool operator()(const Retry& lhs, const Retry& rhs) const { return lhs.first > rhs.first; }
+    };
+    std::priority_queue<Retry, vector<Retry>, RetryLater> retries_;
+    size_t half_open_ = 0;
+    size_t connected_ = 0;
+    uint64_t downloaded_ = 0;
+
+    TimerWheel::Timer tick_timer_{[this] { tick(); }};
+    vector<uint32_t> pending_haves_;
+    TimerWheel::Timer have_timer_{[this] { flush_haves(); }};
+    Clock::time_point last_replace_ = Clock::now();
+    PeerCache cache_;
+    Clock::time_point last_cache_save_ = Clock::now();
+    Clock::time_point last_pex_ = Clock::now();
+
+    void tick();
+    [[nodiscard]] bool is_local_host(uint32_t ip) const;
+    // start connecting to ready candidates, as far as the caps allow
+    void dial();
+    // start connecting to a candidate; false if it isn't idle
+    bool connect(const Address& addr);
+    void add_piece(uint32_t index);
+    void replace_slowest();
+    void save_cache();
+    // tell every peer that speaks ut_pex about the peers we're connected to
+    void send_pex();
+    void flush_haves();
+};
+
+#endif //PICOTOR_CONNECTIONS_HPP
@@ -0,0 +1,146 @@
+#ifndef PICOTOR_DHT_HPP
+#define PICOTOR_DHT_HPP
+
+#include <array>
+#include <functional>
+#include <random>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+
+#include <bencode.hpp>
+#include <routingtable.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using ba::ip::udp;
+namespace bs = boost::system;
+
+// a node in the mainline DHT (BEP 5). we keep a Kademlia routing table of other nodes, answer their queries, and
+// look up peers for our torrent: an iterative get_peers walk towards the info-hash, handing every peer it returns to
+// the connection manager, then announce_peer to the closest nodes that gave us a token. the routing table is saved
+// to a file so the next run doesn't have to bootstrap from scratch. only touched from the io thread.
+class Dht {
+public:
+    typedef RoutingTable::NodeId NodeId;
+
+    // state_path is where the routing table is kept between runs
+    Dht(const TorrentContext& ctx, uint16_t port, string state_path);
+
+    // load the routing table, bootstrap from the given routers ("host", "port") if it's thin, and start looking up
+    // peers
+    void start(const vector<std::pair<string, string>>& routers);
+
+    // ask a node we've heard about (e.g. from a peer's Port message) to join our routing table
+    void add_node(const udp::endpoint& endpoint);
+
+    [[nodiscard]] const NodeId& id() const { return table_.id(); }
+    [[nodiscard]] size_t nodes() const { return table_.size(); }
+    [[nodiscard]] const RoutingTable& table() const { return table_; }
+
+private:
+    typedef chrono::steady_clock Clock;
+    // called with the response dict, or nullptr if the query failed or timed out
+    typedef std::function<void(const bencode::dict_view* response)> Callback;
+
+    // a query waiting for its response
+    struct Pending {
+        Pending(udp::endpoint endpoint_, Callback callback_, std::function<void()> on_timeout)
+            : endpoint(std::move(endpoint_)), callback(std::move(callback_)), timeout(std::move(on_timeout)) {}
+
+        udp::endpoint endpoint;
+        Callback callback;
+        TimerWheel::Timer timeout;
+    };
+
+    // the nodes an iterative get_peers lookup has heard of, closest to the target first
+    struct Candidate {
+        enum State { Fresh, Querying, Responded, Failed };
+
+        NodeId id;
+        udp::endpoint endpoint;
+        State state = Fresh;
+        string token;
+    };
+
+    // Kademlia parameters
+    static constexpr size_t K = RoutingTable::K;
+    static constexpr size_t ALPHA = 3;
+    // a lookup keeps at most this many nodes it hasn't asked yet
+    static constexpr size_t MAX_CANDIDATES = 64;
+    // peers announced to us that we hand out, per info-hash and overall
+    static constexpr size_t MAX_PEERS_PER_HASH = 100;
+    static constexpr size_t MAX_HASHES = 1000;
+    const chrono::milliseconds QUERY_TIMEOUT = 5s;
+    // announced peers are forgotten after this long
+    const chrono::milliseconds PEER_LIFETIME = 30min;
+    // tokens are valid for two rotations of the secret
+    const chrono::milliseconds SECRET_INTERVAL = 5min;
+    const chrono::milliseconds SAVE_INTERVAL = 5min;
+
+    const TorrentContext& ctx_;
+    const uint16_t port_;
+    const string state_path_;
+    std::mt19937 rng_{std::random_device{}()};
+    RoutingTable table_;
+    // the info-hash, which is what we look up
+    NodeId target_;
+
+    udp::socket socket_;
+    udp::resolver resolver_;
+    udp::endpoint sender_;
+    vector<char> recv_buffer_;
+
+    std::unordered_map<uint16_t, Pending> pending_;
+    uint16_t next_transaction_;
+
+    // the lookup in progress, if any
+    vector<Candidate> lookup_;
+    bool looking_up_ = false;
+    // responses to an earlier lookup's queries are ignored
+    uint32_t lookup_round_ = 0;
+    size_t in_flight_ = 0;
+    size_t lookup_peers_ = 0;
+
+    // peers other nodes announced to us, by info-hash
+    std::unordered_map<string, vector<std::pair<Address, Clock::time_point>>> peers_;
+    string secret_;
+    string previous_secret_;
+
+    TimerWheel::Timer lookup_timer_{[this] { start_lookup(); }};
+    TimerWheel::Timer secret_timer_{[this] { rotate_secret(); }};
+    TimerWheel::Timer save_timer_{[this] { save(); }};
+
+    // routing table state
+    void load();
+    void save();
+
+    // KRPC
+    void async_receive();
+    void on_packet(size_t length);
+    void on_query(const string& transaction, const string& method, const bencode::dict_view& args);
+    void query(const udp::endpoint& endpoint, const string& method, bencode::dict args, Callback callback);
+    void expire(uint16_t transaction);
+    // reply to the query we're handling
+    void respond(const string& transaction, bencode::dict values);
+    void error(const string& transaction, int code, const string& reason);
+    void send(const udp::endpoint& endpoint, bencode::dict message);
+
+    // lookups
+    void start_lookup();
+    void add_candidate(const NodeId& id, const udp::endpoint& endpoint);
+    void step_lookup();
+    void on_lookup_response(const NodeId& id, const bencode::dict_view* response);
+    void finish_lookup();
+    // parse compact node info, adding each node to the routing table (unverified) and the lookup
+    void learn_nodes(const bencode::dict_view& response);
+
+    // tokens and announced peers
+    void rotate_secret();
+    [[nodiscard]] string token_for(const udp::endpoint& endpoint, const string& secret) const;
+    [[nodiscard]] string compact_nodes(const NodeId& target) const;
+
+    [[nodiscard]] static std::ostream& log() { return std::cout << "[dht] "; }
+};
+
+#endif //PICOTOR_DHT_HPP
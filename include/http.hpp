@@ -0,0 +1,59 @@
+#ifndef PICOTOR_HTTP_HPP
+#define PICOTOR_HTTP_HPP
+
+#include <cstddef>
+#include <string>
+
+using std::string;
+
+// the parts of a URL needed to make a request to it: scheme://host[:port][/path]
+struct Url {
+    explicit Url(const string& url);
+
+    string host;
+    // the port, or 80 if there isn't one
+    string service;
+    string path;
+};
+
+// incremental HTTP/1.1 response parser. bytes are fed in as they arrive off the socket; the status and headers are
+// parsed as soon as they're complete, and the body is collected (and de-chunked) until its end is known, so there's
+// no need to wait for the server to close the connection
+class HttpParser {
+public:
+    enum State { Headers, Body, BodyToEof, ChunkSize, ChunkData, ChunkEnd, Done, Error };
+
+    explicit HttpParser(size_t max_body): max_body_(max_body) {}
+
+    // parse more of the response; false if it's malformed or too big
+    bool feed(const char* data, size_t length);
+    // the server closed the connection; completes a body with no declared length
+    void feed_eof();
+    // start over, for the next response on a keep-alive connection
+    void reset();
+
+    [[nodiscard]] State state() const { return state_; }
+    [[nodiscard]] bool done() const { return state_ == Done; }
+    [[nodiscard]] bool headers_done() const { return state_ != Headers && state_ != Error; }
+    [[nodiscard]] int status() const { return status_; }
+    [[nodiscard]] bool keep_alive() const { return keep_alive_; }
+    [[nodiscard]] const string& body() const { return body_; }
+
+private:
+    static constexpr size_t MAX_HEADERS = 16 * 1024;
+
+    const size_t max_body_;
+    State state_ = Headers;
+    // bytes received but not yet parsed
+    string pending_;
+    string body_;
+    int status_ = 0;
+    bool keep_alive_ = true;
+    // body bytes still to come: the whole body with a Content-Length, or the current chunk
+    size_t remaining_ = 0;
+
+    bool parse_headers();
+    bool fail() { state_ = Error; return false; }
+};
+
+#endif //PICOTOR_HTTP_HPP
@@ -0,0 +1,47 @@
+#ifndef PICOTOR_LISTENER_HPP
+#define PICOTOR_LISTENER_HPP
+
+#include <boost/asio.hpp>
+
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using ba::ip::tcp;
+namespace bs = boost::system;
+
+// accepts connections from peers on the port we announce. each one has to send a handshake for our torrent within
+// the connect timeout; then it's handed to the connection manager, which runs it like any other peer if there's room.
+// only touched from the io thread.
+class Listener {
+public:
+    Listener(const TorrentContext& ctx, uint16_t port);
+
+    void start();
+
+private:
+    // a connection that hasn't finished its handshake yet
+    struct Pending {
+        explicit Pending(tcp::socket socket_): socket(std::move(socket_)) {}
+
+        tcp::socket socket;
+        vector<char> handshake;
+        TimerWheel::Timer timeout{[this] { socket.close(); }};
+    };
+
+    // delay before accepting again after an error; doubles while the errors continue
+    const chrono::milliseconds MIN_BACKOFF = 100ms;
+    const chrono::milliseconds MAX_BACKOFF = 10s;
+
+    const TorrentContext& ctx_;
+    tcp::acceptor acceptor_;
+    chrono::milliseconds backoff_ = MIN_BACKOFF;
+    TimerWheel::Timer retry_timer_{[this] { async_accept(); }};
+
+    void async_accept();
+    void async_read_handshake(tcp::socket socket);
+    void on_handshake(const shared_ptr<Pending>& pending);
+
+    static std::ostream& log() { return std::cout << "[listener] "; }
+};
+
+#endif //PICOTOR_LISTENER_HPP
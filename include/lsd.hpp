@@ -0,0 +1,43 @@
+#ifndef PICOTOR_LSD_HPP
+#define PICOTOR_LSD_HPP
+
+#include <random>
+
+#include <boost/asio.hpp>
+
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using ba::ip::udp;
+namespace bs = boost::system;
+
+// local service discovery (BEP 14): announces our torrent and port to the LAN by multicast, and hands peers that
+// announce the same torrent to the connection manager, which dials them ahead of everyone else. only touched from the
+// io thread.
+class LocalDiscovery {
+public:
+    LocalDiscovery(const TorrentContext& ctx, uint16_t port);
+
+    void start();
+
+private:
+    const TorrentContext& ctx_;
+    const uint16_t port_;
+    const udp::endpoint group_;
+    // tells our own announcements apart from other clients' when they come back to us
+    string cookie_;
+
+    udp::socket socket_;
+    udp::endpoint sender_;
+    vector<char> recv_buffer_;
+
+    TimerWheel::Timer announce_timer_{[this] { announce(); }};
+
+    void announce();
+    void async_receive();
+    void on_announce(const string& message);
+
+    static std::ostream& log() { return std::cout << "[lsd] "; }
+};
+
+#endif //PICOTOR_LSD_HPP
@@ -20,15 +20,24 @@ using std::vector;
 using cmn::Hash;
 
 struct Handshake {
+    // bit of extensions[5] for the extension protocol (BEP 10)
+    static constexpr char EXTENSION_PROTOCOL = 0x10;
+
     string protocol_str{"BitTorrent protocol"};
     char extensions[8];
     Hash info_hash;
     string peer_id;
 
-    Handshake(cmn::Hash hash, const char* id): info_hash(std::move(hash)), peer_id(id), extensions{0} {}
+    // our own handshake, which offers the extension protocol if we have any extensions enabled
+    Handshake(cmn::Hash hash, const char* id, bool extension_protocol)
+        : info_hash(std::move(hash)), peer_id(id), extensions{0} {
+        if (extension_protocol) extensions[5] |= EXTENSION_PROTOCOL;
+    }
 
     explicit Handshake(const vector<char>& data);
 
+    [[nodiscard]] bool extension_protocol() const { return (extensions[5] & EXTENSION_PROTOCOL) != 0; }
+
     [[nodiscard]] vector<char> serialise() const;
 };
 
@@ -46,31 +55,70 @@ struct Message {
         Extension = 20,
     };
 
+    // extended message id of the extension handshake; the peer picks the ids for everything else
+    static constexpr uint8_t EXTENDED_HANDSHAKE = 0;
+
     explicit Message(const vector<char>& data);
 
     [[nodiscard]] static string type_to_string(Type type);
     [[nodiscard]] static optional<Type> try_from(uint8_t src);
 
+    [[nodiscard]] static Message choke() {
+        return Message{Message::Type::Choke, vector<char>{}};
+    }
+    [[nodiscard]] static Message unchoke() {
+        return Message{Message::Type::Unchoke, vector<char>{}};
+    }
     [[nodiscard]] static Message interested() {
         return Message{Message::Type::Interested, vector<char>{}};
     }
-    [[nodiscard]] static Message request(const class::Piece& piece, const Block& block) {
+    [[nodiscard]] static Message not_interested() {
+        return Message{Message::Type::NotInterested, vector<char>{}};
+    }
+    [[nodiscard]] static Message have(uint32_t piece_index) {
         vector<char> data;
-        data.reserve(12);
-        cmn::push_bytes(&data, htonl(piece.index()));
-        cmn::push_bytes(&data, htonl(block.offset()));
-        cmn::push_bytes(&data, htonl(std::min(piece.size() - block.offset(), BLOCK_SIZE)));
-        return Message{Message::Type::Request, data};
+        data.reserve(4);
+        cmn::push_bytes(&data, htonl(piece_index));
+        return Message{Message::Type::Have, data};
+    }
+    [[nodiscard]] static Message bitfield(const cmn::Bitfield& pieces) {
+        return Message{Message::Type::Bitfield, pieces.to_bytes()};
+    }
+    [[nodiscard]] static Message request(uint32_t piece_index, uint32_t piece_size, const Block& block) {
+        return Message{Message::Type::Request, block_payload(piece_index, piece_size, block)};
+    }
+    [[nodiscard]] static Message cancel(uint32_t piece_index, uint32_t piece_size, const Block& block) {
+        return Message{Message::Type::Cancel, block_payload(piece_index, piece_size, block)};
+    }
+    // the extended message id, then a bencoded dict
+    [[nodiscard]] static Message extended(uint8_t id, const string& dict) {
+        vector<char> data;
+        data.reserve(1 + dict.size());
+        data.push_back(static_cast<char>(id));
+        data.insert(data.end(), dict.begin(), dict.end());
+        return Message{Message::Type::Extension, data};
     }
 
     [[nodiscard]] string to_string() const;
     [[nodiscard]] vector<char> serialize() const;
+    // append the wire encoding to a buffer
+    void serialize_to(vector<char>* out) const;
 
     optional<Type> type;
     vector<char> payload;
 
 private:
     Message(Message::Type type_, vector<char> payload_): type(type_), payload(std::move(payload_)) {}
+
+    // index, begin, length: shared by Request and Cancel
+    static vector<char> block_payload(uint32_t piece_index, uint32_t piece_size, const Block& block) {
+        vector<char> data;
+        data.reserve(12);
+        cmn::push_bytes(&data, htonl(piece_index));
+        cmn::push_bytes(&data, htonl(block.offset()));
+        cmn::push_bytes(&data, htonl(std::min(piece_size - block.offset(), BLOCK_SIZE)));
+        return data;
+    }
 };
 
 #endif //PICOTOR_MESSAGE_HPP
@@ -9,8 +9,13 @@
 #include <boost/asio.hpp>
 #include <boost/lockfree/queue.hpp>
 
+#include <bencode.hpp>
 #include <message.hpp>
+#include <picker.hpp>
+#include <piecetable.hpp>
+#include <timerwheel.hpp>
 #include <torrent.hpp>
+#include <upload.hpp>
 
 using std::cout;
 using std::ostream;
@@ -24,9 +29,46 @@ namespace bs = boost::system;
 using cmn::Address;
 using cmn::Bitfield;
 
-class Peer {
+class Peer : public std::enable_shared_from_this<Peer> {
 public:
     Peer(const TorrentContext& ctx, cmn::Address addr);
+    // a peer that connected to us, whose handshake we've already read
+    Peer(const TorrentContext& ctx, cmn::Address addr, tcp::socket socket, const Handshake& handshake);
+
+    // connect (or answer the handshake of an inbound peer) and run the protocol; keeps itself alive while any
+    // operation is in flight
+    void start();
+    void close();
+
+    [[nodiscard]] double download_rate() { return download_rate_.rate(); }
+    [[nodiscard]] double upload_rate() { return upload_rate_.rate(); }
+    [[nodiscard]] bool peer_interested() const { return peer_interested_; }
+    [[nodiscard]] bool am_choking() const { return am_choking_; }
+
+    // choke or unchoke the peer, if that changes anything
+    void set_choking(bool choking);
+
+    // queue Have messages for newly-written pieces the peer doesn't already have, in a single write
+    void announce(const vector<uint32_t>& pieces);
+
+    // we finished a piece; the peer may no longer have anything we want
+    void on_piece_completed(uint32_t index);
+
+    // request blocks until the pipeline is full, if we're allowed to
+    void async_download();
+
+    // send the next block the peer asked for. returns true if it should get another turn
+    bool serve_next();
+
+    [[nodiscard]] ostream& log() const {
+        return cout << "[" << (peer_id_.empty() ? addr_.to_string() : cmn::urlencode(peer_id_)) << "] ";
+    }
+
+    // another peer delivered a block we also requested (endgame); tell the remote end not to bother
+    void cancel(uint32_t piece, uint32_t block);
+
+    // tell the peer which of our peers it hasn't heard about from us, and which have gone, if it speaks ut_pex
+    void send_pex(const vector<Address>& connected);
 
 private:
     // handshake_write -> handshake_read -> next
@@ -35,68 +77,151 @@ private:
     void async_handshake_write(const bs::error_code& ec);
     void async_handshake_read(const bs::error_code& ec);
     void async_next(const bs::error_code& ec);
+    void on_handshake();
     void async_read_message();
     void async_read_len(const bs::error_code& ec);
     void async_handle_message();
 
-    void async_download();
+    // queue a message; everything queued while a write is in flight goes out together in the next one
     void async_write_message(const Message& msg) {
-        async_write_message(msg, [](auto& ec, auto _) {});
+        msg.serialize_to(&outbox());
+        async_flush();
     }
-    template <class T>
-    void async_write_message(const Message& msg, const T& handler) {
-        ba::async_write(socket_, ba::buffer(msg.serialize()), handler);
-    }
-
+    // where to queue bytes: once a file range follows the outbox, nothing more can go between it and its header
+    vector<char>& outbox() { return outbox_file_ ? after_file_ : outbox_; }
+    void async_flush();
+    void async_sendfile();
+    void finish_write();
+    void send_keepalive();
+
+    void handle_have(const Message& msg);
+    void handle_bitfield(const Message& msg);
+    void handle_request(const Message& msg);
+    void handle_cancel(const Message& msg);
+    void handle_interested(bool interested);
+    void send_extended_handshake();
+    void handle_extension(const Message& msg);
+    void handle_pex(const bencode::dict_view& pex);
+    // get a turn from the uploader if we have requests queued and room to send them
+    void schedule_upload();
+    // send Interested or NotInterested if whether the peer has anything we want has changed
+    void update_interest();
     void handle_piece(const Message& msg);
 
-    void release_block(uint32_t index) {
-        const auto block = blocks_.find(index);
-        if (block != blocks_.end()) {
-            block->second->release();
-            blocks_.erase(block);
+    void release_block(uint64_t key) {
+        const auto request = requests_.find(key);
+        if (request != requests_.end()) {
+            request->second.ref.block->release(this);
+            requests_.erase(request);
         }
     }
 
-    void release_piece() {
-        if (piece_) {
-            while (!ctx_.work_queue->push(piece_->index()));
-            piece_.reset();
+    // hand our reserved blocks back to the piece table; blocks we already received stay there
+    void release_requests() {
+        for (auto& [_, request] : requests_) {
+            request.ref.block->release(this);
         }
+        requests_.clear();
     }
 
-    void close() {
-        closed_ = true;
-        release_piece();
-        socket_.close();
-        while (!ctx_.result_queue->push(ResultPeerDropped{addr_}));
-    }
 
-    [[nodiscard]] ostream& log() const {
-        return cout << "[" << (peer_id_.empty() ? addr_.to_string() : cmn::urlencode(peer_id_)) << "] ";
-    }
+    // a block we've asked for, and the deadline for receiving it
+    struct Request {
+        Request(BlockRef ref_, std::function<void()> on_timeout)
+            : ref(std::move(ref_)), deadline(std::move(on_timeout)), sent(chrono::steady_clock::now()) {}
+
+        BlockRef ref;
+        TimerWheel::Timer deadline;
+        chrono::steady_clock::time_point sent;
+    };
+
+    void on_request_timeout(uint64_t key);
+    void on_block_received(const Request& request, uint32_t length);
+    [[nodiscard]] chrono::milliseconds request_timeout() const;
+    [[nodiscard]] uint32_t pipeline_limit();
 
     // parameters
-    const uint32_t PIPELINE_LIMIT = 5;
-    const chrono::milliseconds TIMEOUT_MS = 7500ms;
+    const uint32_t INITIAL_PIPELINE = 5;
+    const uint32_t MAX_PIPELINE = 64;
+    // keep enough requests outstanding to cover this long at the peer's current rate
+    const chrono::milliseconds PIPELINE_TARGET = 3s;
+    const chrono::milliseconds INITIAL_TIMEOUT = 7500ms;
+    const chrono::milliseconds MIN_TIMEOUT = 2s;
+    const chrono::milliseconds MAX_TIMEOUT = 60s;
+    // a peer that times out this many times in a row without sending anything is considered dead
+    const uint32_t MAX_TIMEOUTS = 4;
+    const chrono::milliseconds KEEPALIVE_INTERVAL = 90s;
+    // our extended message id for ut_pex
+    const uint8_t PEX_ID = 1;
+    // peers per list in a ut_pex message, both ways, and how often we'll listen to one
+    const size_t MAX_PEX_PEERS = 50;
+    const chrono::milliseconds MIN_PEX_INTERVAL = 45s;
     const Address addr_;
     const TorrentContext& ctx_;
 
     // networking data
     vector<char> recv_buffer_;
+    // bytes waiting for the current write to finish, and the bytes of the current write. each may be followed by a
+    // range of the file, sent with sendfile after the bytes; anything queued after that range waits in after_file_
+    struct FileRange {
+        uint64_t offset;
+        uint32_t length;
+    };
+    vector<char> outbox_;
+    optional<FileRange> outbox_file_;
+    vector<char> after_file_;
+    vector<char> sending_;
+    optional<FileRange> sending_file_;
+    bool writing_ = false;
     tcp::socket socket_;
     string peer_id_;
 
+    // performance data: smoothed round-trip time and its variance (RFC 6298), in ms
+    optional<double> srtt_;
+    double rttvar_ = 0;
+    cmn::RateMeter download_rate_;
+    // snubbed peers get one request at a time until they deliver again
+    bool snubbed_ = false;
+    uint32_t timeouts_ = 0;
+
     // protocol data
     bool choked_ = true;
+    bool interested_ = false;
+    bool peer_interested_ = false;
+    bool am_choking_ = true;
     Bitfield available_pieces_;
-    optional<Piece> piece_;
-    unordered_map<uint32_t, shared_ptr<Block>> blocks_;
+    // number of pieces the peer has that we don't; we're interested while this is nonzero
+    size_t wanted_ = 0;
+    // outstanding requests, keyed by BlockRef::key()
+    unordered_map<uint64_t, Request> requests_;
+    TimerWheel::Timer keepalive_timer_{[this] { send_keepalive(); }};
+    TimerWheel::Timer handshake_timer_{[this] {
+        // closing may drop the last reference to us, so not from inside our own timer
+        ba::post(ctx_.io, [self = shared_from_this()] {
+            if (self->connected_ || self->closed_) return;
+            self->log() << "timed out connecting" << std::endl;
+            self->close();
+        });
+    }};
+
+    // extension protocol (BEP 10): whether the peer offered it, and the id it wants for ut_pex (0 if none)
+    bool extensions_ = false;
+    uint8_t pex_id_ = 0;
+    // the peers we've told it about
+    std::unordered_set<Address> pex_sent_;
+    optional<chrono::steady_clock::time_point> last_pex_received_;
+
+    // uploads: requests from the peer we haven't served yet
+    std::deque<UploadRequest> upload_queue_;
+    bool upload_scheduled_ = false;
+    cmn::RateMeter upload_rate_;
 
     // state
+    const bool inbound_ = false;
+    bool connected_ = false;
     bool closed_ = false;
 };
 
-void monitor_thread(const TorrentContext& ctx, const unique_ptr<vector<Peer>>&& peers);
+void monitor_thread(const TorrentContext& ctx);
 
 #endif //PICOTOR_PEER_HPP
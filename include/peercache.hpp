@@ -0,0 +1,55 @@
+#ifndef PICOTOR_PEERCACHE_HPP
+#define PICOTOR_PEERCACHE_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <common.hpp>
+
+using std::string;
+using std::vector;
+using cmn::Address;
+
+// peers we've talked to in earlier runs, kept in a small binary file per torrent so that a restart can dial the
+// best of them before any tracker has answered. entries score by the download rate we last saw from them, halved
+// for every day since we saw them and divided by their recent failures; old ones are dropped. only touched from
+// the io thread.
+class PeerCache {
+public:
+    explicit PeerCache(string path): path_(std::move(path)) {}
+
+    // read the file, returning the peers worth trying, best first
+    vector<Address> load();
+    // write the file, replacing the old one in one go
+    void save() const;
+
+    // a peer completed its handshake
+    void connected(const Address& addr);
+    // a connected peer is sending us data at this rate, or was when it left
+    void seen(const Address& addr, double rate);
+    // we couldn't connect to a peer
+    void failed(const Address& addr);
+
+private:
+    struct Entry {
+        uint64_t last_seen;
+        float rate;
+        uint32_t failures;
+    };
+
+    static constexpr uint32_t MAGIC = 0x50544331;
+    static constexpr uint64_t DAY = 24 * 60 * 60;
+    // entries unseen for this long are forgotten, as are ones that keep failing
+    static constexpr uint64_t MAX_AGE = 14 * DAY;
+    static constexpr uint32_t MAX_FAILURES = 5;
+    static constexpr size_t MAX_ENTRIES = 1000;
+
+    const string path_;
+    std::unordered_map<Address, Entry> entries_;
+
+    [[nodiscard]] static double score(const Entry& entry, uint64_t now);
+    [[nodiscard]] static uint64_t now();
+};
+
+#endif //PICOTOR_PEERCACHE_HPP
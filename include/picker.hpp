@@ -0,0 +1,78 @@
+#ifndef PICOTOR_PICKER_HPP
+#define PICOTOR_PICKER_HPP
+
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <common.hpp>
+
+using std::optional;
+using std::vector;
+using cmn::Bitfield;
+
+// rarest-first piece picker. pieces we haven't started yet are kept in one array sorted by availability (the number
+// of connected peers that have them), with the start of each availability level recorded. a change in availability
+// swaps the piece to the edge of its level and moves the boundary, so it costs O(1); pieces within a level are kept in
+// random order so that peers don't all converge on the same piece. picking looks at the first few entries, then falls
+// back to a word-parallel walk over the pieces the peer has. only touched from the io thread.
+class PiecePicker {
+public:
+    explicit PiecePicker(uint32_t pieces);
+
+    // availability updates from Bitfield and Have messages, and from peers disconnecting
+    void add_peer(const Bitfield& available);
+    void remove_peer(const Bitfield& available);
+    void add_have(uint32_t index);
+
+    // pick the rarest piece the peer has, taking it out of the picker
+    optional<uint32_t> pick(const Bitfield& available);
+
+    // put a piece back, e.g. after it failed its hash check
+    void requeue(uint32_t index);
+    // take a piece out without picking it, e.g. because it turned out to be on disk already
+    void discard(uint32_t index) {
+        if (position_[index] != NOT_QUEUED) remove(index);
+    }
+
+    [[nodiscard]] uint32_t availability(uint32_t index) const { return availability_[index]; }
+    // true if the piece is still waiting to be picked
+    [[nodiscard]] bool queued(uint32_t index) const { return position_[index] != NOT_QUEUED; }
+    [[nodiscard]] size_t remaining() const { return order_.size(); }
+
+private:
+    static constexpr uint32_t NOT_QUEUED = UINT32_MAX;
+    // how far into the order to look before walking the peer's bitfield instead
+    static constexpr uint32_t SCAN_LIMIT = 64;
+
+    // pieces not yet picked, sorted by availability
+    vector<uint32_t> order_;
+    // position of each piece in order_, or NOT_QUEUED
+    vector<uint32_t> position_;
+    vector<uint32_t> availability_;
+    // level_start_[a] is the position of the first piece in order_ with availability >= a
+    vector<uint32_t> level_start_;
+    // the same pieces as order_, as a bitfield for whole-word intersection with a peer's
+    Bitfield queued_;
+    std::mt19937 rng_{std::random_device{}()};
+
+    void increment(uint32_t index);
+    void decrement(uint32_t index);
+    void remove(uint32_t index);
+
+    [[nodiscard]] uint32_t level_end(uint32_t level) const {
+        return level + 1 < level_start_.size() ? level_start_[level + 1] : static_cast<uint32_t>(order_.size());
+    }
+    void ensure_level(uint32_t level) {
+        while (level_start_.size() <= level) level_start_.push_back(order_.size());
+    }
+    void swap(uint32_t pos_a, uint32_t pos_b) {
+        std::swap(order_[pos_a], order_[pos_b]);
+        position_[order_[pos_a]] = pos_a;
+        position_[order_[pos_b]] = pos_b;
+    }
+    // swap a piece with a random one of the same availability, so ties are broken randomly
+    void shuffle_within_level(uint32_t index);
+};
+
+#endif //PICOTOR_PICKER_HPP
@@ -0,0 +1,94 @@
+#ifndef PICOTOR_PIECETABLE_HPP
+#define PICOTOR_PIECETABLE_HPP
+
+#include <map>
+
+#include <common.hpp>
+#include <picker.hpp>
+#include <torrent.hpp>
+
+using cmn::Bitfield;
+
+// a block some peer has committed to downloading
+struct BlockRef {
+    uint32_t piece;
+    shared_ptr<Block> block;
+
+    // unique key for the block across the whole torrent
+    [[nodiscard]] uint64_t key() const { return key_of(piece, block->index()); }
+    static uint64_t key_of(uint32_t piece, uint32_t block) { return (static_cast<uint64_t>(piece) << 32) | block; }
+};
+
+struct AcceptResult {
+    BlockStatus status;
+    uint32_t piece;
+    uint32_t block;
+    uint32_t length;
+    // in endgame, other peers that requested the same block, and should be sent a Cancel
+    vector<Peer*> duplicates;
+};
+
+// torrent-wide table of partially-downloaded pieces. several peers can fetch blocks of the same piece at once,
+// and blocks stay here when the peer that fetched them drops. only touched from the io thread.
+//
+// once every remaining block has been requested, the table enters endgame: blocks that are already outstanding are
+// handed out again to other peers, so the last few pieces don't wait on the slowest peer. a piece that fails its hash
+// check and is requeued takes the table out of endgame again.
+class PieceTable {
+public:
+    PieceTable(const SingleFileTorrent& tor, shared_ptr<PiecePicker> picker)
+        : tor_(tor), picker_(std::move(picker)), have_(tor.pieces()), left_(tor.file_length()) {}
+
+    // reserve a block available from a peer, preferring pieces that are already in progress
+    optional<BlockRef> reserve(const Bitfield& available, Peer* requester);
+
+    // store the payload of a Piece message
+    AcceptResult accept(const vector<char>& payload, const Address& from, const Peer* sender);
+
+    // remove a complete piece from the table, handing ownership of its data to the caller
+    CompletePiece take_complete(uint32_t index);
+
+    // put a piece that failed its hash check back in the picker, to be downloaded from scratch. there's unrequested
+    // work again, so endgame ends until it has all been requested
+    void requeue(uint32_t index) {
+        picker_->requeue(index);
+        endgame_ = false;
+    }
+
+    [[nodiscard]] bool is_complete(uint32_t index) const {
+        const auto it = partial_.find(index);
+        return it != partial_.end() && it->second.is_complete();
+    }
+    [[nodiscard]] bool single_source(uint32_t index) const {
+        const auto it = partial_.find(index);
+        return it != partial_.end() && it->second.single_source();
+    }
+    // pieces we have verified
+    [[nodiscard]] const Bitfield& have() const { return have_; }
+    void mark_have(uint32_t index) {
+        if (have_.get(index)) return;
+        have_.set(index);
+        left_ -= tor_.piece_size(index);
+    }
+    // bytes of the file we don't have yet
+    [[nodiscard]] uint64_t left() const { return left_; }
+
+    [[nodiscard]] size_t in_progress() const { return partial_.size(); }
+    [[nodiscard]] bool endgame() const { return endgame_; }
+
+private:
+    // most peers that can request the same block in endgame
+    static constexpr size_t MAX_DUPLICATES = 3;
+
+    const SingleFileTorrent& tor_;
+    shared_ptr<PiecePicker> picker_;
+    // ordered so that older (lower-index) pieces are finished first
+    std::map<uint32_t, Piece> partial_;
+    Bitfield have_;
+    uint64_t left_;
+    bool endgame_ = false;
+
+    [[nodiscard]] bool all_requested() const;
+};
+
+#endif //PICOTOR_PIECETABLE_HPP
@@ -23,6 +23,18 @@ struct ResultPeerDropped {
     Address addr;
 };
 
-typedef variant<ResultPieceComplete, ResultPeerConnected, ResultPeerDropped> Result;
+// a piece a previous run left on disk passed its hash check
+struct ResultPieceResumed {
+    uint32_t index;
+};
+
+struct ResultEndgame {};
+
+struct ResultBytesWasted {
+    uint32_t bytes;
+};
+
+typedef variant<ResultPieceComplete, ResultPieceResumed, ResultPeerConnected, ResultPeerDropped, ResultEndgame,
+                ResultBytesWasted> Result;
 
 #endif //PICOTOR_RESULT_HPP
@@ -0,0 +1,10 @@
+#ifndef PICOTOR_RESUME_HPP
+#define PICOTOR_RESUME_HPP
+
+#include <torrent.hpp>
+
+// runs alongside the download at startup: preallocate the file, then hash whatever a previous run left in it. pieces
+// that check out are handed to the connection manager as if we'd just downloaded them, and to the monitor
+void resume_thread(const TorrentContext& ctx);
+
+#endif //PICOTOR_RESUME_HPP
@@ -0,0 +1,62 @@
+#ifndef PICOTOR_ROUTINGTABLE_HPP
+#define PICOTOR_ROUTINGTABLE_HPP
+
+#include <array>
+#include <chrono>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace ba = boost::asio;
+namespace chrono = std::chrono;
+using ba::ip::udp;
+using std::vector;
+
+// the DHT's Kademlia routing table: nodes in 160 buckets by how many leading bits their id shares with ours, at
+// most K per bucket. a full bucket only takes a new node in place of one that's failing, or, for a node we've heard
+// from ourselves, one we only know about second-hand. only touched from the io thread.
+class RoutingTable {
+public:
+    typedef std::array<uint8_t, 20> NodeId;
+    typedef chrono::steady_clock Clock;
+
+    struct Node {
+        NodeId id;
+        udp::endpoint endpoint;
+        Clock::time_point last_seen;
+        // nodes we've only heard about from others are replaced first
+        bool verified = false;
+        uint32_t failures = 0;
+    };
+
+    static constexpr size_t K = 8;
+    static constexpr size_t BUCKETS = 160;
+    // a node that fails this many queries in a row is dropped
+    static constexpr uint32_t MAX_FAILURES = 3;
+
+    explicit RoutingTable(const NodeId& id): id_(id) {}
+
+    [[nodiscard]] const NodeId& id() const { return id_; }
+    // take on the id from a previous run; only while the table is empty
+    void set_id(const NodeId& id) { id_ = id; }
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] size_t bucket_of(const NodeId& id) const;
+    [[nodiscard]] const vector<Node>& bucket(size_t index) const { return buckets_[index]; }
+
+    // add a node, or refresh it if we heard from it ourselves
+    void insert(const NodeId& id, const udp::endpoint& endpoint, bool verified);
+    // a query to the node at this endpoint went unanswered
+    void failed(const udp::endpoint& endpoint);
+    // up to count nodes, closest to the target first
+    [[nodiscard]] vector<Node> closest(const NodeId& target, size_t count) const;
+
+    // is a closer to the target than b, by XOR distance?
+    static bool closer(const NodeId& a, const NodeId& b, const NodeId& target);
+
+private:
+    NodeId id_;
+    std::array<vector<Node>, BUCKETS> buckets_;
+};
+
+#endif //PICOTOR_ROUTINGTABLE_HPP
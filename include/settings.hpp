@@ -0,0 +1,64 @@
+#ifndef PICOTOR_SETTINGS_HPP
+#define PICOTOR_SETTINGS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std::chrono_literals;
+
+// tunables shared by the whole client. defaults are sensible for a single torrent on a well-connected host
+struct Settings {
+    // connection manager
+    uint32_t max_connections = 50;
+    uint32_t max_half_open = 8;
+    // new connection attempts started per connection manager tick
+    uint32_t connects_per_tick = 4;
+    std::chrono::milliseconds connect_timeout = 10s;
+    // first retry delay after a failed or dropped connection; doubles with each failure
+    std::chrono::milliseconds retry_backoff = 15s;
+    uint32_t max_failures = 5;
+    // how often to consider replacing the slowest peer with a fresh candidate
+    std::chrono::milliseconds replace_interval = 30s;
+    // remember peers across runs, in a file next to the download, and how often to write it
+    bool peer_cache = true;
+    std::chrono::milliseconds peer_cache_interval = 60s;
+    // find peers through the mainline DHT as well as trackers, looking them up again this often
+    bool dht = true;
+    std::chrono::milliseconds dht_lookup_interval = 15min;
+    // swap peer lists with connected peers (ut_pex), this often
+    bool pex = true;
+    std::chrono::milliseconds pex_interval = 60s;
+    // announce ourselves to the LAN by multicast (BEP 14), this often
+    bool lsd = true;
+    std::chrono::milliseconds lsd_interval = 5min;
+    // download from the torrent's web seeds (url-list) as well as from peers
+    bool web_seeds = true;
+    // Have messages for completed pieces are batched up and sent this often
+    std::chrono::milliseconds have_flush_interval = 500ms;
+
+    // trackers: announce early when fewer than min_peers are connected, but never more often than
+    // min_announce_interval
+    uint32_t min_peers = 10;
+    std::chrono::milliseconds min_announce_interval = 60s;
+
+    // uploads: peers unchoked by the choker, not counting the optimistic unchoke. when our upload capacity (bytes/s)
+    // is known, we instead unchoke one peer for every upload_slot_rate of it
+    uint32_t upload_slots = 4;
+    uint64_t upload_capacity = 0;
+    uint64_t upload_slot_rate = 32 * 1024;
+    // how often the choker re-ranks peers, and how often the optimistic unchoke moves to another peer
+    std::chrono::milliseconds rechoke_interval = 10s;
+    std::chrono::milliseconds optimistic_interval = 30s;
+    // requests a peer may have queued with us; more are ignored
+    size_t max_upload_queue = 250;
+    // stop serving a peer while this many bytes are waiting to be sent to it
+    size_t upload_buffer = 64 * 1024;
+    // send block data with sendfile(2) instead of reading it into memory (Linux only)
+    bool zero_copy_uploads = true;
+    // bytes of whole pieces kept in memory for serving requests, or with zero-copy uploads, read ahead into the page
+    // cache; 0 turns the cache off
+    size_t read_cache_size = 16 * 1024 * 1024;
+};
+
+#endif //PICOTOR_SETTINGS_HPP
@@ -0,0 +1,27 @@
+#ifndef PICOTOR_STARTUP_HPP
+#define PICOTOR_STARTUP_HPP
+
+#include <atomic>
+#include <chrono>
+
+// how long it takes to get going: the time from process start to each stage of startup, logged the first time the
+// stage is reached. the first block is the one we care about most. safe to use from any thread.
+class Startup {
+public:
+    enum Milestone {
+        TorrentLoaded,
+        TrackerReply,
+        PeerConnected,
+        FirstBlock,
+        ResumeChecked,
+        MILESTONES,
+    };
+
+    void reached(Milestone milestone);
+
+private:
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    std::atomic<bool> reached_[MILESTONES] = {};
+};
+
+#endif //PICOTOR_STARTUP_HPP
@@ -0,0 +1,29 @@
+#ifndef PICOTOR_STORAGE_HPP
+#define PICOTOR_STORAGE_HPP
+
+#include <string>
+
+using std::string;
+
+// read access to the downloaded file, for serving other peers. writes still go through the monitor
+class Storage {
+public:
+    explicit Storage(string path): path_(std::move(path)) {}
+    ~Storage();
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+
+    // read exactly `length` bytes at `offset`; false if the file isn't there or is too short
+    bool read(uint64_t offset, uint32_t length, char* out);
+    // ask the kernel to start reading a range into its page cache, without waiting for it
+    void prefetch(uint64_t offset, uint32_t length);
+
+    // the file descriptor, opened on first use since the monitor creates the file; -1 if it can't be opened
+    int fd();
+
+private:
+    string path_;
+    int fd_ = -1;
+};
+
+#endif //PICOTOR_STORAGE_HPP
@@ -0,0 +1,92 @@
+#ifndef PICOTOR_TIMERWHEEL_HPP
+#define PICOTOR_TIMERWHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <functional>
+
+#include <boost/asio.hpp>
+
+namespace ba = boost::asio;
+namespace chrono = std::chrono;
+
+// hierarchical timer wheel, driven by a single periodic tick on the io thread. arming and disarming a timer is O(1):
+// timers are intrusive list nodes, placed in a slot of the level whose span covers their deadline, and cascade down
+// a level each time the level below wraps around. use one wheel per io thread; it is not thread-safe.
+class TimerWheel {
+    struct Link {
+        Link* prev = this;
+        Link* next = this;
+
+        [[nodiscard]] bool linked() const { return next != this; }
+        void unlink() {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+        void push_back(Link* node) {
+            node->prev = prev;
+            node->next = this;
+            prev->next = node;
+            prev = node;
+        }
+        // move every node of other to the end of this list
+        void splice(Link& other) {
+            if (!other.linked()) return;
+            other.next->prev = prev;
+            other.prev->next = this;
+            prev->next = other.next;
+            prev = other.prev;
+            other.prev = other.next = &other;
+        }
+    };
+
+public:
+    // embed in the object that owns the deadline; it is disarmed automatically when destroyed
+    class Timer : private Link {
+    public:
+        explicit Timer(std::function<void()> callback): callback_(std::move(callback)) {}
+        ~Timer() { disarm(); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        [[nodiscard]] bool armed() const { return linked(); }
+        void disarm() { unlink(); }
+
+    private:
+        std::function<void()> callback_;
+        uint64_t expiry_ = 0;
+
+        friend class TimerWheel;
+    };
+
+    TimerWheel(ba::io_context& io, chrono::milliseconds resolution): tick_timer_(io), resolution_(resolution) {}
+
+    // start ticking; timers can be armed before this, but won't fire until it's called
+    void start();
+
+    // (re-)arm a timer to fire after at least `delay`
+    void arm(Timer& timer, chrono::milliseconds delay);
+
+    [[nodiscard]] chrono::milliseconds resolution() const { return resolution_; }
+
+private:
+    static constexpr uint64_t SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr size_t LEVELS = 4;
+
+    ba::steady_timer tick_timer_;
+    const chrono::milliseconds resolution_;
+    chrono::steady_clock::time_point start_;
+    uint64_t now_ = 0;
+    std::array<std::array<Link, SLOTS>, LEVELS> slots_;
+
+    void schedule_tick();
+    void tick();
+    void insert(Timer& timer);
+    // re-insert the timers in a slot of an upper level; returns the slot index, so the caller knows if it wrapped
+    uint64_t cascade(size_t level);
+};
+
+#endif //PICOTOR_TIMERWHEEL_HPP
@@ -4,6 +4,7 @@
 
 #ifndef PICOTOR_TORRENT_HPP
 #define PICOTOR_TORRENT_HPP
+#include <algorithm>
 #include <optional>
 #include <memory>
 #include <string>
@@ -36,15 +37,25 @@ public:
     }
 
     [[nodiscard]] const string& announce() const { return announce_; }
+    // tracker URLs in tiers, from announce-list if there is one, otherwise just announce
+    [[nodiscard]] const vector<vector<string>>& trackers() const { return trackers_; }
+    // HTTP servers with a copy of the file (BEP 19)
+    [[nodiscard]] const vector<string>& web_seeds() const { return web_seeds_; }
     [[nodiscard]] const string& filename() const { return filename_; }
     [[nodiscard]] const Hash& info_hash() const { return info_hash_; }
     [[nodiscard]] uint32_t file_length() const { return file_length_; }
-    [[nodiscard]] uint32_t pieces() const { return file_length_ / piece_length_; }
+    [[nodiscard]] uint32_t pieces() const { return (file_length_ + piece_length_ - 1) / piece_length_; }
     [[nodiscard]] uint32_t piece_size() const { return piece_length_; }
+    // the final piece is usually shorter than the others
+    [[nodiscard]] uint32_t piece_size(uint32_t index) const {
+        return std::min(piece_length_, file_length_ - index * piece_length_);
+    }
     [[nodiscard]] const Hash& piece_hash(uint32_t index) const { return piece_hashes_[index]; }
 
 private:
     string announce_;
+    vector<vector<string>> trackers_;
+    vector<string> web_seeds_;
     string filename_;
     uint32_t piece_length_;
     uint32_t file_length_;
@@ -55,11 +66,14 @@ private:
 class TrackerResponse {
 public:
     explicit TrackerResponse(const string_view& data);
+    TrackerResponse(uint32_t interval, vector<Address> peers): interval_(interval), peers_(std::move(peers)) {}
 
     [[nodiscard]] const vector<Address>& peers() const { return peers_; }
+    // seconds the tracker wants us to wait before announcing again
+    [[nodiscard]] uint32_t interval() const { return interval_; }
 
 private:
-    [[maybe_unused]] uint32_t interval_;
+    uint32_t interval_;
     vector<Address> peers_;
 };
 
@@ -88,17 +102,24 @@ inline const char* block_status_string(BlockStatus status) {
     }
 }
 
+class Peer;
+
 class Block {
 public:
     explicit Block(uint32_t offset): offset_(offset), data_{0}, len_(0) {}
     [[nodiscard]] bool filled() const { return filled_; }
     [[nodiscard]] uint32_t offset() const { return offset_; }
     [[nodiscard]] uint32_t index() const { return offset_ / BLOCK_SIZE; }
-    void release() { reserved_ = false; }
+    [[nodiscard]] bool reserved() const { return !requesters_.empty(); }
+    // peers with an outstanding request for this block; more than one only in endgame
+    [[nodiscard]] const vector<Peer*>& requesters() const { return requesters_; }
+    void release(const Peer* peer) {
+        requesters_.erase(std::remove(requesters_.begin(), requesters_.end(), peer), requesters_.end());
+    }
 
 private:
     bool filled_ = false;
-    bool reserved_ = false;
+    vector<Peer*> requesters_;
     char data_[BLOCK_SIZE];
     size_t len_;
     uint32_t offset_;
@@ -116,31 +137,36 @@ private:
 
 class CompletePiece {
 public:
-    CompletePiece(): data_(nullptr), piece_index_(0), size_(0) {}
-    CompletePiece(char* data, uint32_t piece_index, uint32_t size)
-            : data_(data), piece_index_(piece_index), size_(size) {}
+    CompletePiece(): data_(nullptr), piece_index_(0), offset_(0), size_(0) {}
+    CompletePiece(char* data, uint32_t piece_index, uint32_t offset, uint32_t size)
+            : data_(data), piece_index_(piece_index), offset_(offset), size_(size) {}
 
     [[nodiscard]] cmn::Hash hash() const { return cmn::Hash::of(std::string{data_, size_}); }
     void free() { delete[] data_; }
 
     [[nodiscard]] char* data() const { return data_; }
     [[nodiscard]] uint32_t index() const { return piece_index_; }
-    [[nodiscard]] uint32_t offset() const { return piece_index_ * size_; }
+    [[nodiscard]] uint32_t offset() const { return offset_; }
     [[nodiscard]] uint32_t size() const { return size_; }
 private:
     char* data_; // TODO: unique_ptr?
     uint32_t piece_index_;
+    uint32_t offset_;
     uint32_t size_;
 };
 
 class Piece {
 public:
-    Piece(uint32_t index, uint32_t piece_size): index_(index), piece_size_(piece_size) {}
+    Piece(uint32_t index, uint32_t offset, uint32_t piece_size)
+        : index_(index), offset_(offset), piece_size_(piece_size) {}
 
     [[nodiscard]] uint32_t index() const { return index_; }
     [[nodiscard]] uint32_t size() const { return piece_size_; }
 
-    [[nodiscard]] std::pair<BlockStatus, uint32_t> accept(const vector<char>& payload) {
+    // true if every block so far came from the same peer, so a failed hash check can be blamed on it
+    [[nodiscard]] bool single_source() const { return !mixed_sources_; }
+
+    [[nodiscard]] std::pair<BlockStatus, uint32_t> accept(const vector<char>& payload, const Address& from) {
         // 8 bytes used for initial data
         const uint32_t data_len = payload.size() - 8;
         stringstream ss;
@@ -156,22 +182,31 @@ public:
         if (data_len > BLOCK_SIZE) return std::pair{BlockStatus::TooMuchData, block_index};
         if (piece_index != index_) return std::pair{BlockStatus::WrongPiece, block_index};
         if (block_index >= blocks_.size()) return std::pair{BlockStatus::WrongOffset, block_index};
-        return std::pair{blocks_[block_index]->fill(ss, data_len), block_index};
+
+        const auto result = blocks_[block_index]->fill(ss, data_len);
+        if (result == BlockStatus::Ok) {
+            if (!source_) {
+                source_ = from;
+            } else if (!(*source_ == from)) {
+                mixed_sources_ = true;
+            }
+        }
+        return std::pair{result, block_index};
     }
 
-    shared_ptr<Block> next_block() {
+    shared_ptr<Block> next_block(Peer* requester) {
         if (blocks_.size() < block_count()) {
             // if there's a block we haven't started yet, give them that
             const auto offset = static_cast<uint32_t>(blocks_.size() * BLOCK_SIZE);
             blocks_.push_back(std::make_shared<Block>(offset));
             const auto block = *(blocks_.end() - 1);
-            block->reserved_ = true;
+            block->requesters_.push_back(requester);
             return block;
         } else {
             // otherwise, look for one that's not reserved
-            for (const auto block : blocks_) {
-                if (!block->filled_ && !block->reserved_) {
-                    block->reserved_ = true;
+            for (const auto& block : blocks_) {
+                if (!block->filled_ && !block->reserved()) {
+                    block->requesters_.push_back(requester);
                     return block;
                 }
             }
@@ -179,6 +214,28 @@ public:
         return nullptr;
     }
 
+    // endgame: find an outstanding block someone else has requested, preferring the least-requested one
+    shared_ptr<Block> duplicate_block(Peer* requester, size_t max_requesters) {
+        shared_ptr<Block> best;
+        for (const auto& block : blocks_) {
+            if (block->filled_ || block->requesters_.size() >= max_requesters) continue;
+            const auto& others = block->requesters_;
+            if (std::find(others.begin(), others.end(), requester) != others.end()) continue;
+            if (!best || others.size() < best->requesters_.size()) best = block;
+        }
+        if (best) best->requesters_.push_back(requester);
+        return best;
+    }
+
+    [[nodiscard]] const shared_ptr<Block>& block(uint32_t index) const { return blocks_[index]; }
+
+    // true if some block has not been requested from anyone yet
+    [[nodiscard]] bool has_free_block() const {
+        return blocks_.size() < block_count()
+            || std::any_of(blocks_.cbegin(), blocks_.cend(),
+                           [](const auto& block) { return !block->filled() && !block->reserved(); });
+    }
+
     [[nodiscard]] bool is_complete() const {
         const auto all_filled = std::all_of(blocks_.cbegin(), blocks_.cend(),
                                       [](auto block) { return block->filled(); });
@@ -195,15 +252,18 @@ public:
                 ptr += block->len_;
             }
 
-            finalized_ = CompletePiece{data, index_, piece_size_};
+            finalized_ = CompletePiece{data, index_, offset_, piece_size_};
         }
         return *finalized_;
     }
 
 private:
     uint32_t index_;
+    uint32_t offset_;
     uint32_t piece_size_;
     vector<shared_ptr<Block>> blocks_;
+    optional<Address> source_;
+    bool mixed_sources_ = false;
 
     // cached result
     optional<CompletePiece> finalized_;
@@ -218,14 +278,27 @@ private:
 };
 
 #include <result.hpp>
+#include <settings.hpp>
+
+class ConnectionManager;
+class PiecePicker;
+class PieceTable;
+class Startup;
+class TimerWheel;
+class Uploader;
 
 struct TorrentContext {
     ba::io_context& io;
+    const Settings& settings;
     const vector<char>& handshake;
     const SingleFileTorrent& tor;
-    shared_ptr<boost::lockfree::queue<uint32_t>> work_queue;
     shared_ptr<boost::lockfree::queue<Result>> result_queue;
-    size_t total_peers;
+    shared_ptr<PiecePicker> picker;
+    shared_ptr<PieceTable> pieces;
+    shared_ptr<TimerWheel> timers;
+    shared_ptr<ConnectionManager> connections;
+    shared_ptr<Uploader> uploads;
+    Startup& startup;
 };
 
 #endif //PICOTOR_TORRENT_HPP
\ No newline at end of file
@@ -0,0 +1,231 @@
+#ifndef PICOTOR_TRACKER_HPP
+#define PICOTOR_TRACKER_HPP
+
+#include <functional>
+#include <memory>
+#include <random>
+
+#include <boost/asio.hpp>
+
+#include <http.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using ba::ip::tcp;
+using ba::ip::udp;
+namespace bs = boost::system;
+
+// what we tell a tracker about ourselves when we announce
+struct AnnounceParams {
+    string peer_id;
+    uint16_t port;
+    uint64_t uploaded = 0;
+    uint64_t downloaded = 0;
+    uint64_t left = 0;
+    uint32_t numwant = 50;
+    // sent with the first announce to a tracker, once we finish downloading, and when we leave; in the order BEP 15
+    // numbers them
+    enum Event { None, Completed, Started, Stopped };
+    Event event = None;
+};
+
+// a tracker we can announce to, over whichever protocol its URL asks for. announces run on the io thread, and
+// trackers keep themselves alive while one is in flight
+class Tracker {
+public:
+    // the response, or nothing if the announce failed
+    typedef std::function<void(optional<TrackerResponse>)> Handler;
+
+    virtual ~Tracker() = default;
+
+    // an HTTP or UDP tracker for the URL; nothing if we don't speak its protocol
+    static shared_ptr<Tracker> create(const TorrentContext& ctx, const string& url);
+
+    // one announce at a time; the handler is called exactly once
+    virtual void announce(const AnnounceParams& params, Handler handler) = 0;
+    [[nodiscard]] virtual bool busy() const = 0;
+
+    [[nodiscard]] const string& url() const { return url_; }
+
+protected:
+    explicit Tracker(string url);
+
+    const string url_;
+    // parsed from the URL
+    string host_;
+    string service_;
+    string path_;
+
+    [[nodiscard]] std::ostream& log() const { return std::cout << "[" << url_ << "] "; }
+};
+
+// announces to an HTTP tracker: resolve, connect, send the request and parse the reply as it arrives. the whole
+// exchange has to finish within the timeout
+class HttpTracker : public Tracker, public std::enable_shared_from_this<HttpTracker> {
+public:
+    HttpTracker(const TorrentContext& ctx, string url);
+
+    void announce(const AnnounceParams& params, Handler handler) override;
+    [[nodiscard]] bool busy() const override { return static_cast<bool>(handler_); }
+
+private:
+    const chrono::milliseconds TIMEOUT = 15s;
+    // tracker responses are small; anything bigger than this isn't one
+    static constexpr size_t MAX_RESPONSE = 1024 * 1024;
+
+    const TorrentContext& ctx_;
+    tcp::resolver resolver_;
+    tcp::socket socket_;
+    string request_;
+    vector<char> read_buffer_;
+    HttpParser parser_{MAX_RESPONSE};
+    Handler handler_;
+    // handlers from an earlier announce that finish late are ignored
+    uint32_t attempt_ = 0;
+    TimerWheel::Timer timeout_{[this] { fail("timed out"); }};
+
+    [[nodiscard]] string target(const AnnounceParams& params) const;
+    [[nodiscard]] bool stale(uint32_t attempt) const { return attempt != attempt_ || !handler_; }
+    void async_read(uint32_t attempt);
+    void on_response();
+    void fail(const string& reason);
+    void finish(optional<TrackerResponse> response);
+};
+
+// how many peers a tracker knows about for a torrent
+struct ScrapeInfo {
+    uint32_t seeders;
+    uint32_t completed;
+    uint32_t leechers;
+};
+
+// announces to (and scrapes) a UDP tracker (BEP 15). each exchange gets a connection ID first, which is reused for
+// a minute; requests that go unanswered are sent again after 15 * 2^n seconds
+class UdpTracker : public Tracker, public std::enable_shared_from_this<UdpTracker> {
+public:
+    // the counts for each info-hash, in the order asked for, or nothing if the scrape failed
+    typedef std::function<void(optional<vector<ScrapeInfo>>)> ScrapeHandler;
+
+    UdpTracker(const TorrentContext& ctx, string url);
+
+    void announce(const AnnounceParams& params, Handler handler) override;
+    [[nodiscard]] bool busy() const override { return handler_ || scrape_handler_; }
+
+    // scrape any number of torrents; they're batched into as few packets as the protocol allows
+    void scrape(vector<Hash> hashes, ScrapeHandler handler);
+
+private:
+    enum Action : uint32_t { Connect = 0, Announce = 1, Scrape = 2, Error = 3 };
+
+    static constexpr uint64_t PROTOCOL_ID = 0x41727101980;
+    const chrono::milliseconds RETRANSMIT_TIMEOUT = 15s;
+    const chrono::milliseconds CONNECTION_ID_LIFETIME = 60s;
+    // BEP 15 allows up to 8 retransmissions, but that's over an hour; after this many we try again at the next
+    // announce instead
+    static constexpr uint32_t MAX_ATTEMPTS = 4;
+    // hashes that fit in one scrape packet
+    static constexpr size_t MAX_SCRAPE = 74;
+
+    const TorrentContext& ctx_;
+    udp::resolver resolver_;
+    udp::socket socket_;
+    optional<udp::endpoint> endpoint_;
+    udp::endpoint sender_;
+    optional<uint64_t> connection_id_;
+    chrono::steady_clock::time_point connected_at_;
+    std::mt19937 rng_{std::random_device{}()};
+    // identifies us to the tracker across announces, in case our address changes
+    const uint32_t key_ = rng_();
+
+    // the request in flight
+    Action action_ = Connect;
+    vector<char> packet_;
+    uint32_t transaction_ = 0;
+    uint32_t attempt_ = 0;
+    vector<char> recv_buffer_;
+    bool receiving_ = false;
+    TimerWheel::Timer retransmit_timer_{[this] { on_timeout(); }};
+
+    AnnounceParams params_;
+    Handler handler_;
+    vector<Hash> scrape_hashes_;
+    vector<ScrapeInfo> scrape_results_;
+    ScrapeHandler scrape_handler_;
+
+    void begin(Action action);
+    // send the request, connecting first if our connection ID has expired
+    void send_request();
+    void transmit();
+    void async_receive();
+    void on_receive(size_t length);
+    void on_timeout();
+    void fail(const string& reason);
+    void finish();
+};
+
+// announces to the torrent's trackers, tier by tier (BEP 12). the first announce goes to every tracker at once, so
+// peers reach the connection manager as soon as the quickest one answers. trackers that answer are then moved ahead
+// of ones that don't, fastest first, and later announces go to the best tracker in each tier, falling back to the
+// next one if it fails. we announce again at the interval the trackers ask for, or sooner if we run low on peers.
+// only touched from the io thread.
+class Announcer {
+public:
+    Announcer(const TorrentContext& ctx, string peer_id, uint16_t port);
+
+    // announce now, and keep announcing
+    void start();
+    // tell the trackers we announced to that we're leaving. done is called once they've all answered, or after a
+    // timeout
+    void stop(std::function<void()> done);
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    // until a tracker tells us otherwise
+    const chrono::milliseconds DEFAULT_INTERVAL = 30min;
+    const chrono::milliseconds CHECK_INTERVAL = 5s;
+    const chrono::milliseconds STOP_TIMEOUT = 5s;
+
+    struct Entry {
+        shared_ptr<Tracker> tracker;
+        // how long the last successful announce took
+        optional<Clock::duration> latency;
+        uint32_t failures = 0;
+        // the last announce round this tracker was tried in
+        uint32_t round = 0;
+        // whether it has accepted our started and completed events
+        bool started = false;
+        bool completed = false;
+    };
+
+    const TorrentContext& ctx_;
+    AnnounceParams params_;
+    vector<vector<Entry>> tiers_;
+    uint32_t round_ = 0;
+    Clock::time_point last_announce_;
+    TimerWheel::Timer announce_timer_{[this] { announce(); }};
+    TimerWheel::Timer check_timer_{[this] { check_peers(); }};
+    // whether we've finished downloading, as of the last check
+    bool finished_ = false;
+    bool stopping_ = false;
+    size_t pending_stops_ = 0;
+    std::function<void()> on_stopped_;
+    TimerWheel::Timer stop_timer_{[this] { stopped(); }};
+
+    void announce();
+    // announce early if we're short of peers, or if we've just finished
+    void check_peers();
+    void update_params();
+    [[nodiscard]] AnnounceParams::Event event_for(const Entry& entry) const;
+    void stopped();
+
+    // announce to the best tracker in the tier not yet tried this round
+    void announce_next(size_t tier);
+    void announce_to(size_t tier, Entry& entry);
+    void send_announce(size_t tier, const shared_ptr<Tracker>& tracker, const AnnounceParams& params);
+
+    void on_response(size_t tier, const Tracker* tracker, Clock::time_point sent, bool complete,
+                     const optional<TrackerResponse>& response);
+};
+
+#endif //PICOTOR_TRACKER_HPP
@@ -0,0 +1,86 @@
+#ifndef PICOTOR_UPLOAD_HPP
+#define PICOTOR_UPLOAD_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <random>
+
+#include <cache.hpp>
+#include <storage.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+class Peer;
+
+// a block another peer asked us for
+struct UploadRequest {
+    uint32_t piece;
+    uint32_t offset;
+    uint32_t length;
+
+    bool operator==(const UploadRequest& rhs) const = default;
+};
+
+// chooses which peers to unchoke, and serves their queued Request messages. every rechoke interval, the interested
+// peers that send us the most (or take the most from us, once we're seeding) are unchoked, plus one optimistic
+// unchoke that rotates between the rest so new peers get a chance to prove themselves. unchoked peers with requests
+// queued (and room in their send buffer) take turns, one block each, so a peer with a deep queue can't starve the
+// rest. only touched from the io thread, except for the counters.
+class Uploader {
+public:
+    Uploader(const TorrentContext& ctx, const Settings& settings);
+
+    void start();
+
+    // a peer has requests queued; it gets a turn in the next round
+    void ready(const shared_ptr<Peer>& peer);
+
+    // unchoke slots. between rechokes, newly interested peers are unchoked straight away while slots are free
+    [[nodiscard]] uint32_t slots() const;
+    [[nodiscard]] bool has_free_slot() const { return unchoked_ < slots() + 1; }
+    void take_slot() { ++unchoked_; }
+    void release_slot() { --unchoked_; }
+
+    // read a block into the end of a buffer; false if we can't
+    bool read_block(const UploadRequest& request, vector<char>* out);
+
+    // zero-copy uploads: block data is sent with sendfile(2) from the file straight to the socket. the read cache
+    // then only reads pieces ahead, so their blocks are already in the page cache when they're sent
+    [[nodiscard]] bool can_sendfile();
+    void prefetch(const UploadRequest& request) {
+        if (cache_.enabled()) cache_.prefetch(request.piece);
+    }
+    [[nodiscard]] int file_fd() { return storage_.fd(); }
+    [[nodiscard]] uint64_t file_offset(const UploadRequest& request) const {
+        return static_cast<uint64_t>(request.piece) * ctx_.tor.piece_size() + request.offset;
+    }
+
+    void count(uint32_t bytes) { uploaded_ += bytes; }
+    [[nodiscard]] uint64_t uploaded() const { return uploaded_; }
+    [[nodiscard]] const ReadCache& cache() const { return cache_; }
+
+private:
+    // blocks served per turn of the io loop, so uploads can't hog it
+    static constexpr uint32_t BLOCKS_PER_PUMP = 64;
+
+    const TorrentContext& ctx_;
+    const Settings& settings_;
+    const bool zero_copy_;
+    Storage storage_;
+    ReadCache cache_;
+    std::deque<std::weak_ptr<Peer>> ready_;
+    bool pump_scheduled_ = false;
+    uint32_t unchoked_ = 0;
+    std::atomic<uint64_t> uploaded_ = 0;
+
+    TimerWheel::Timer choke_timer_{[this] { rechoke(); }};
+    std::weak_ptr<Peer> optimistic_;
+    chrono::steady_clock::time_point last_optimistic_;
+    std::mt19937 rng_{std::random_device{}()};
+
+    void pump();
+    void rechoke();
+};
+
+#endif //PICOTOR_UPLOAD_HPP
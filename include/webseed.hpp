@@ -0,0 +1,86 @@
+#ifndef PICOTOR_WEBSEED_HPP
+#define PICOTOR_WEBSEED_HPP
+
+#include <boost/asio.hpp>
+
+#include <common.hpp>
+#include <http.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+using ba::ip::tcp;
+using cmn::Bitfield;
+namespace bs = boost::system;
+
+// downloads from an HTTP server with a copy of the file (a web seed, BEP 19), as if it were one more peer with every
+// piece. it takes a run of consecutive pieces from the picker, starting at the rarest, fetches them with one Range
+// request over a keep-alive connection, and hash-checks and writes each piece like one from a peer. the run grows
+// with the measured throughput so that each request takes about RANGE_TARGET. only touched from the io thread.
+class WebSeed {
+public:
+    WebSeed(const TorrentContext& ctx, string url);
+
+    // a web seed for the URL; nothing if we don't speak its protocol
+    static std::unique_ptr<WebSeed> create(const TorrentContext& ctx, const string& url);
+
+    void start();
+
+private:
+    // the largest range we'll ask for at once, and how long each request should take at the current rate
+    static constexpr uint64_t MAX_RANGE = 16 * 1024 * 1024;
+    const chrono::milliseconds RANGE_TARGET = 5s;
+    // give up on a request when nothing arrives for this long
+    const chrono::milliseconds TIMEOUT = 30s;
+    // after a failure, wait RETRY_DELAY * 2^(failures - 1), up to MAX_RETRY_DELAY
+    const chrono::milliseconds RETRY_DELAY = 10s;
+    const chrono::milliseconds MAX_RETRY_DELAY = 10min;
+    // how often to look for more work when the picker has nothing for us
+    const chrono::milliseconds IDLE_INTERVAL = 5s;
+
+    const TorrentContext& ctx_;
+    const string url_;
+    const Url parts_;
+    Bitfield everything_;
+
+    tcp::resolver resolver_;
+    tcp::socket socket_;
+    string request_;
+    vector<char> read_buffer_;
+    // no response we'd accept is bigger than the file, or than one run of pieces
+    HttpParser parser_;
+    // handlers from an earlier request that finish late are ignored
+    uint32_t attempt_ = 0;
+    // whether the request went out on a connection left open by the last one, and how much has come back
+    bool reused_ = false;
+    uint64_t received_ = 0;
+
+    // the run of pieces being fetched, if any
+    uint32_t first_ = 0;
+    uint32_t count_ = 0;
+    chrono::steady_clock::time_point requested_at_;
+    // smoothed throughput in bytes/s, once we've measured it
+    double rate_ = 0;
+    uint32_t failures_ = 0;
+
+    TimerWheel::Timer timeout_{[this] { fail("timed out"); }};
+    TimerWheel::Timer retry_timer_{[this] { next(); }};
+
+    // pick the next run and request it
+    void next();
+    [[nodiscard]] uint32_t run_length() const;
+    void async_connect(uint32_t attempt);
+    void async_request(uint32_t attempt);
+    void async_read(uint32_t attempt);
+    void on_response();
+    // hand the run's pieces back to the picker and back off
+    void fail(const string& reason);
+    // the same, but for good: the seed won't be asked again
+    void disable(const string& reason);
+    // drop the request in flight and hand its pieces back
+    void abort();
+    void back_off();
+
+    [[nodiscard]] std::ostream& log() const { return std::cout << "[" << url_ << "] "; }
+};
+
+#endif //PICOTOR_WEBSEED_HPP
@@ -0,0 +1,63 @@
+#include <cache.hpp>
+
+bool ReadCache::read(uint32_t piece, uint32_t offset, uint32_t length, vector<char>* out) {
+    const auto entry = get(piece);
+    if (!entry || static_cast<uint64_t>(offset) + length > entry->data.size()) return false;
+    out->insert(out->end(), entry->data.begin() + offset, entry->data.begin() + offset + length);
+    return true;
+}
+
+const ReadCache::Entry* ReadCache::get(uint32_t piece) {
+    const auto it = index_.find(piece);
+    if (it != index_.end() && !it->second->data.empty()) {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &*it->second;
+    }
+    // a piece that was only read ahead still has to be read in
+    if (it != index_.end()) {
+        size_ -= tor_.piece_size(piece);
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    // read ahead the whole piece
+    ++misses_;
+    vector<char> data(tor_.piece_size(piece));
+    const auto offset = static_cast<uint64_t>(piece) * tor_.piece_size();
+    if (!storage_.read(offset, data.size(), data.data())) return nullptr;
+    return insert(piece, std::move(data));
+}
+
+void ReadCache::prefetch(uint32_t piece) {
+    const auto it = index_.find(piece);
+    if (it != index_.end()) {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+
+    ++misses_;
+    const auto offset = static_cast<uint64_t>(piece) * tor_.piece_size();
+    storage_.prefetch(offset, tor_.piece_size(piece));
+    insert(piece, {});
+}
+
+const ReadCache::Entry* ReadCache::insert(uint32_t piece, vector<char> data) {
+    // pieces that were only read ahead still take up their size, in the page cache
+    size_ += tor_.piece_size(piece);
+    entries_.push_front(Entry{piece, std::move(data)});
+    index_[piece] = entries_.begin();
+    evict();
+    return &entries_.front();
+}
+
+void ReadCache::evict() {
+    // always keep the piece we just read, even if it's bigger than the whole cache
+    while (size_ > capacity_ && entries_.size() > 1) {
+        auto& last = entries_.back();
+        size_ -= tor_.piece_size(last.piece);
+        index_.erase(last.piece);
+        entries_.pop_back();
+    }
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <iostream>
+
+#include <ifaddrs.h>
+#include <netinet/in.h>
+
+#include <connections.hpp>
+#include <peer.hpp>
+#include <piecetable.hpp>
+
+using std::endl;
+
+// the IPv4 subnets our interfaces are on, as (address, mask) pairs in host order
+static vector<std::pair<uint32_t, uint32_t>> local_subnets() {
+    vector<std::pair<uint32_t, uint32_t>> subnets;
+    ifaddrs* interfaces = nullptr;
+    if (::getifaddrs(&interfaces) != 0) return subnets;
+    for (auto it = interfaces; it; it = it->ifa_next) {
+        if (!it->ifa_addr || !it->ifa_netmask || it->ifa_addr->sa_family != AF_INET) continue;
+        const auto addr = ntohl(reinterpret_cast<const sockaddr_in*>(it->ifa_addr)->sin_addr.s_addr);
+        const auto mask = ntohl(reinterpret_cast<const sockaddr_in*>(it->ifa_netmask)->sin_addr.s_addr);
+        subnets.emplace_back(addr & mask, mask);
+    }
+    ::freeifaddrs(interfaces);
+    return subnets;
+}
+
+ConnectionManager::ConnectionManager(const TorrentContext& ctx, const Settings& settings)
+    : ctx_(ctx), settings_(settings), subnets_(local_subnets()), cache_(ctx.tor.filename() + ".peers") {}
+
+void ConnectionManager::start() {
+    ctx_.timers->arm(tick_timer_, TICK_INTERVAL);
+
+    // peers that did well last time get dialled first, before any tracker has answered
+    if (settings_.peer_cache) {
+        const auto cached = cache_.load();
+        if (!cached.empty()) {
+            std::cout << "[connections] " << cached.size() << " peers from the peer cache" << endl;
+            add_candidates(cached);
+        }
+    }
+}
+
+void ConnectionManager::add_candidates(const vector<Address>& addrs) {
+    for (const auto& addr : addrs) {
+        if (candidates_.try_emplace(addr).second) {
+            ready_.push_back(addr);
+        }
+    }
+    known_ = candidates_.size();
+
+    // the first peers matter most for getting started, so don't wait for the next tick
+    dial();
+}
+
+void ConnectionManager::add_local(const Address& addr) {
+    auto& candidate = candidates_[addr];
+    known_ = candidates_.size();
+    local_hosts_.insert(addr.raw);
+    if (!candidate.local) std::cout << "[connections] found " << addr.to_string() << " on the LAN" << endl;
+    candidate.local = true;
+
+    // it announces itself periodically, so it's worth another try even if we'd given up on it. it may have connected
+    // to us already, or be waiting out a backoff; otherwise it jumps the queue
+    if (candidate.state == Candidate::Failed) {
+        candidate.state = Candidate::Idle;
+        candidate.failures = 0;
+    }
+    if (candidate.state == Candidate::Idle) {
+        ready_.push_front(addr);
+        dial();
+    }
+}
+
+bool ConnectionManager::accept(ba::ip::tcp::socket socket, const Address& addr, Handshake handshake) {
+    if (connected_ + half_open_ >= settings_.max_connections) return false;
+    const auto [candidate, inserted] = candidates_.try_emplace(addr);
+    if (!inserted && candidate->second.state != Candidate::Idle) return false;
+    candidate->second.state = Candidate::Connecting;
+    candidate->second.inbound = inserted;
+    // it connected from some other port than the one it listens on, so go by its address
+    candidate->second.local = candidate->second.local || is_local_host(addr.raw);
+    known_ = candidates_.size();
+    ++half_open_;
+
+    const auto peer = std::make_shared<Peer>(ctx_, addr, std::move(socket), std::move(handshake));
+    peers_[addr] = peer;
+    peer->start();
+    return true;
+}
+
+bool ConnectionManager::is_local_host(uint32_t ip) const {
+    if (local_hosts_.count(ip) > 0) return true;
+    return std::any_of(subnets_.begin(), subnets_.end(), [ip](const auto& subnet) {
+        return (ip & subnet.second) == subnet.first;
+    });
+}
+
+void ConnectionManager::on_connected(const Address& addr) {
+    auto& candidate = candidates_.at(addr);
+    if (candidate.state != Candidate::Connecting) return;
+    candidate.state = Candidate::Connected;
+    candidate.failures = 0;
+    candidate.connected_at = Clock::now();
+    --half_open_;
+    ++connected_;
+    if (!candidate.inbound) cache_.connected(addr);
+}
+
+void ConnectionManager::on_closed(const Address& addr) {
+    auto& candidate = candidates_.at(addr);
+    if (candidate.state == Candidate::Connecting) {
+        --half_open_;
+    } else if (candidate.state == Candidate::Connected) {
+        --connected_;
+    } else {
+        return;
+    }
+
+    // don't destroy the peer from inside one of its own handlers
+    const auto peer = peers_.find(addr);
+    if (peer != peers_.end()) {
+        // remember how it went, for next run
+        if (!candidate.inbound && candidate.state == Candidate::Connected) {
+            cache_.seen(addr, peer->second->download_rate());
+        } else if (!candidate.inbound) {
+            cache_.failed(addr);
+        }
+        ba::post(ctx_.io, [dropped = std::move(peer->second)] {});
+        peers_.erase(peer);
+    }
+
+    if (candidate.inbound) {
+        candidates_.erase(addr);
+        known_ = candidates_.size();
+        return;
+    }
+
+    // try again later, backing off exponentially; give up on peers that never work
+    if (++candidate.failures > settings_.max_failures) {
+        candidate.state = Candidate::Failed;
+        return;
+    }
+    candidate.state = Candidate::Idle;
+    const auto delay = settings_.retry_backoff * (1 << (candidate.failures - 1));
+    retries_.emplace(Clock::now() + delay, addr);
+}
+
+void ConnectionManager::piece_completed(uint32_t index) {
+    // the resume check may have found it first
+    if (ctx_.pieces->have().get(index)) return;
+    downloaded_ += ctx_.tor.piece_size(index);
+    add_piece(index);
+}
+
+void ConnectionManager::piece_resumed(uint32_t index) {
+    if (ctx_.pieces->have().get(index)) return;
+    // unless someone has already started on it, it never needs to be picked
+    ctx_.picker->discard(index);
+    add_piece(index);
+}
+
+void ConnectionManager::add_piece(uint32_t index) {
+    ctx_.pieces->mark_have(index);
+    for (const auto& [_, peer] : peers_) {
+        peer->on_piece_completed(index);
+    }
+
+    pending_haves_.push_back(index);
+    if (!have_timer_.armed()) {
+        ctx_.timers->arm(have_timer_, settings_.have_flush_interval);
+    }
+}
+
+void ConnectionManager::blocks_released() {
+    for (const auto& [_, peer] : peers_) {
+        peer->async_download();
+    }
+}
+
+void ConnectionManager::flush_haves() {
+    for (const auto& [_, peer] : peers_) {
+        peer->announce(pending_haves_);
+    }
+    pending_haves_.clear();
+}
+
+void ConnectionManager::tick() {
+    ctx_.timers->arm(tick_timer_, TICK_INTERVAL);
+
+    // candidates whose backoff has expired go to the back of the line
+    const auto now = Clock::now();
+    while (!retries_.empty() && retries_.top().first <= now) {
+        ready_.push_back(retries_.top().second);
+        retries_.pop();
+    }
+
+    if (now - last_replace_ >= settings_.replace_interval) {
+        last_replace_ = now;
+        replace_slowest();
+    }
+
+    if (settings_.peer_cache && now - last_cache_save_ >= settings_.peer_cache_interval) {
+        last_cache_save_ = now;
+        save_cache();
+    }
+
+    if (settings_.pex && now - last_pex_ >= settings_.pex_interval) {
+        last_pex_ = now;
+        send_pex();
+    }
+
+    dial();
+}
+
+void ConnectionManager::dial() {
+    // pace new connections, so a big tracker response doesn't turn into a burst of SYNs. stale entries (duplicates,
+    // or peers that connected some other way) are skipped without using up a slot
+    for (uint32_t i = 0; i < settings_.connects_per_tick && !ready_.empty();) {
+        if (half_open_ >= settings_.max_half_open) break;
+        if (half_open_ + connected_ >= settings_.max_connections) break;
+        const auto addr = ready_.front();
+        ready_.pop_front();
+        if (connect(addr)) ++i;
+    }
+}
+
+bool ConnectionManager::connect(const Address& addr) {
+    auto& candidate = candidates_.at(addr);
+    if (candidate.state != Candidate::Idle) return false;
+    candidate.state = Candidate::Connecting;
+    ++half_open_;
+
+    const auto peer = std::make_shared<Peer>(ctx_, addr);
+    peers_[addr] = peer;
+    peer->start();
+    return true;
+}
+
+void ConnectionManager::replace_slowest() {
+    // only worth it if every slot is taken and there's someone new to try
+    if (ready_.empty() || connected_ + half_open_ < settings_.max_connections) return;
+
+    // give new peers a full interval to get up to speed. peers we're uploading to are earning their place, and once
+    // we're seeding, how fast a peer takes from us is what counts
+    const auto now = Clock::now();
+    const auto seeding = ctx_.pieces->left() == 0;
+    shared_ptr<Peer> slowest;
+    double slowest_rate = 0;
+    for (const auto& [addr, peer] : peers_) {
+        const auto& candidate = candidates_.at(addr);
+        if (candidate.state != Candidate::Connected) continue;
+        if (now - candidate.connected_at < settings_.replace_interval) continue;
+        if (!peer->am_choking()) continue;
+
+        const auto rate = seeding ? peer->upload_rate() : peer->download_rate();
+        if (!slowest || rate < slowest_rate) {
+            slowest = peer;
+            slowest_rate = rate;
+        }
+    }
+
+    if (slowest) {
+        slowest->log() << "replacing slowest peer (" << slowest_rate / 1024 << "kB/s)" << endl;
+        slowest->close();
+    }
+}
+
+void ConnectionManager::save_cache() {
+    for (const auto& [addr, peer] : peers_) {
+        const auto& candidate = candidates_.at(addr);
+        if (candidate.state == Candidate::Connected && !candidate.inbound) {
+            cache_.seen(addr, peer->download_rate());
+        }
+    }
+    cache_.save();
+}
+
+void ConnectionManager::send_pex() {
+    // only peers we dialled: an inbound peer's address isn't one anyone else can connect to
+    vector<Address> connected;
+    for (const auto& [addr, candidate] : candidates_) {
+        if (candidate.state == Candidate::Connected && !candidate.inbound) connected.push_back(addr);
+    }
+    for (const auto& [_, peer] : peers_) {
+        peer->send_pex(connected);
+    }
+}
@@ -0,0 +1,413 @@
+#include <fstream>
+#include <iostream>
+
+#include <connections.hpp>
+#include <dht.hpp>
+
+using std::endl;
+
+// bencoded values we expect in a message, or nullptr if they're missing or the wrong type
+template<typename T>
+static const T* lookup(const bencode::dict_view& dict, const char* key) {
+    const auto it = dict.find(key);
+    if (it == dict.end()) return nullptr;
+    return std::get_if<T>(&it->second.base());
+}
+
+static optional<Dht::NodeId> to_id(string_view bytes) {
+    if (bytes.size() != 20) return std::nullopt;
+    Dht::NodeId id;
+    std::copy(bytes.begin(), bytes.end(), id.begin());
+    return id;
+}
+
+static string id_string(const Dht::NodeId& id) {
+    return string{id.begin(), id.end()};
+}
+
+// compact endpoints are 4 bytes of IPv4 address then 2 bytes of port, big-endian
+static string compact_endpoint(const udp::endpoint& endpoint) {
+    const auto ip = endpoint.address().to_v4().to_bytes();
+    string bytes{ip.begin(), ip.end()};
+    bytes.push_back(static_cast<char>(endpoint.port() >> 8));
+    bytes.push_back(static_cast<char>(endpoint.port()));
+    return bytes;
+}
+
+static udp::endpoint endpoint_of(const char* bytes) {
+    const Address addr{bytes};
+    return udp::endpoint{ba::ip::address_v4{addr.raw}, addr.port};
+}
+
+static Dht::NodeId random_id(std::mt19937& rng) {
+    Dht::NodeId id;
+    for (auto& byte : id) byte = static_cast<uint8_t>(rng());
+    return id;
+}
+
+Dht::Dht(const TorrentContext& ctx, uint16_t port, string state_path)
+    : ctx_(ctx), port_(port), state_path_(std::move(state_path)), table_(random_id(rng_)), socket_(ctx.io),
+      resolver_(ctx.io), recv_buffer_(2048), next_transaction_(static_cast<uint16_t>(rng_())) {
+    const auto& hash = ctx_.tor.info_hash().as_bytes();
+    std::copy(hash.begin(), hash.end(), target_.begin());
+}
+
+void Dht::start(const vector<std::pair<string, string>>& routers) {
+    bs::error_code ec;
+    socket_.open(udp::v4(), ec);
+    if (!ec) socket_.bind(udp::endpoint{udp::v4(), port_}, ec);
+    if (ec) {
+        log() << "can't listen on port " << port_ << ": " << ec.message() << endl;
+        return;
+    }
+
+    load();
+    async_receive();
+    rotate_secret();
+    ctx_.timers->arm(save_timer_, SAVE_INTERVAL);
+    start_lookup();
+
+    // with a thin routing table, ask the routers for the nodes closest to us; each reply seeds the lookup
+    if (nodes() >= K) return;
+    for (const auto& [host, service] : routers) {
+        resolver_.async_resolve(udp::v4(), host, service, [this](auto ec, auto endpoints) {
+            if (ec) return;
+            for (const auto& entry : endpoints) {
+                bencode::dict args;
+                args["target"] = id_string(table_.id());
+                query(entry.endpoint(), "find_node", std::move(args), [this](auto response) {
+                    if (!response) return;
+                    learn_nodes(*response);
+                    if (!looking_up_) start_lookup();
+                });
+            }
+        });
+    }
+}
+
+void Dht::add_node(const udp::endpoint& endpoint) {
+    // the node joins the routing table if it answers
+    query(endpoint, "ping", bencode::dict{}, [](auto) {});
+}
+
+// on disk: our id, then each node's id and compact endpoint
+void Dht::load() {
+    std::ifstream file{state_path_, std::ios::binary};
+    char id[20];
+    if (!file.read(id, sizeof(id))) return;
+    table_.set_id(*to_id(string_view{id, sizeof(id)}));
+
+    char entry[26];
+    while (file.read(entry, sizeof(entry))) {
+        // they were good last time, but we haven't heard from them in this run
+        table_.insert(*to_id(string_view{entry, 20}), endpoint_of(entry + 20), false);
+    }
+    log() << "loaded " << nodes() << " nodes" << endl;
+}
+
+void Dht::save() {
+    ctx_.timers->arm(save_timer_, SAVE_INTERVAL);
+
+    const auto temp = state_path_ + ".tmp";
+    {
+        std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+        file << id_string(table_.id());
+        for (size_t i = 0; i < RoutingTable::BUCKETS; ++i) {
+            for (const auto& node : table_.bucket(i)) {
+                if (node.verified && node.failures == 0) file << id_string(node.id) << compact_endpoint(node.endpoint);
+            }
+        }
+        if (!file) return;
+    }
+    std::rename(temp.c_str(), state_path_.c_str());
+}
+
+void Dht::async_receive() {
+    socket_.async_receive_from(ba::buffer(recv_buffer_), sender_, [this](auto ec, auto length) {
+        if (ec == ba::error::operation_aborted) return;
+        if (!ec && sender_.address().is_v4()) on_packet(length);
+        async_receive();
+    });
+}
+
+void Dht::on_packet(size_t length) {
+    try {
+        const auto message = std::get<bencode::dict_view>(bencode::decode_view(string_view{recv_buffer_.data(), length}));
+        const auto type = lookup<bencode::string_view>(message, "y");
+        const auto transaction = lookup<bencode::string_view>(message, "t");
+        if (!type || !transaction) return;
+
+        if (*type == "q") {
+            const auto method = lookup<bencode::string_view>(message, "q");
+            const auto args = lookup<bencode::dict_view>(message, "a");
+            if (method && args) on_query(string{*transaction}, string{*method}, *args);
+            return;
+        }
+
+        // a response or error to one of our queries, which must come from where we sent it
+        if (transaction->size() != 2) return;
+        const auto id = static_cast<uint16_t>((static_cast<uint8_t>((*transaction)[0]) << 8)
+                                              | static_cast<uint8_t>((*transaction)[1]));
+        const auto pending = pending_.find(id);
+        if (pending == pending_.end() || pending->second.endpoint != sender_) return;
+        auto callback = std::move(pending->second.callback);
+        pending_.erase(pending);
+
+        const auto response = *type == "r" ? lookup<bencode::dict_view>(message, "r") : nullptr;
+        const auto node_id = response ? lookup<bencode::string_view>(*response, "id") : nullptr;
+        if (node_id && to_id(*node_id)) {
+            table_.insert(*to_id(*node_id), sender_, true);
+            callback(response);
+        } else {
+            table_.failed(sender_);
+            callback(nullptr);
+        }
+    } catch (const std::exception&) {
+        // not a KRPC message
+    }
+}
+
+void Dht::on_query(const string& transaction, const string& method, const bencode::dict_view& args) {
+    const auto node_id = lookup<bencode::string_view>(args, "id");
+    if (!node_id || !to_id(*node_id)) return;
+    table_.insert(*to_id(*node_id), sender_, true);
+
+    bencode::dict values;
+    values["id"] = id_string(table_.id());
+    if (method == "ping") {
+        respond(transaction, std::move(values));
+    } else if (method == "find_node") {
+        const auto target = lookup<bencode::string_view>(args, "target");
+        if (!target || !to_id(*target)) return error(transaction, 203, "bad target");
+        values["nodes"] = compact_nodes(*to_id(*target));
+        respond(transaction, std::move(values));
+    } else if (method == "get_peers") {
+        const auto hash = lookup<bencode::string_view>(args, "info_hash");
+        if (!hash || !to_id(*hash)) return error(transaction, 203, "bad info_hash");
+        values["token"] = token_for(sender_, secret_);
+
+        // peers if we have any, otherwise nodes closer to the info-hash
+        const auto now = Clock::now();
+        const auto stored = peers_.find(string{*hash});
+        bencode::list peers;
+        if (stored != peers_.end()) {
+            for (const auto& [addr, announced] : stored->second) {
+                if (now - announced >= PEER_LIFETIME) continue;
+                peers.emplace_back(compact_endpoint(udp::endpoint{ba::ip::address_v4{addr.raw}, addr.port}));
+            }
+        }
+        if (peers.empty()) {
+            values["nodes"] = compact_nodes(*to_id(*hash));
+        } else {
+            values["values"] = std::move(peers);
+        }
+        respond(transaction, std::move(values));
+    } else if (method == "announce_peer") {
+        const auto hash = lookup<bencode::string_view>(args, "info_hash");
+        const auto token = lookup<bencode::string_view>(args, "token");
+        const auto port = lookup<bencode::integer_view>(args, "port");
+        const auto implied = lookup<bencode::integer_view>(args, "implied_port");
+        if (!hash || hash->size() != 20 || !token || (!port && !implied)) return error(transaction, 203, "bad args");
+        if (*token != token_for(sender_, secret_) && *token != token_for(sender_, previous_secret_)) {
+            return error(transaction, 203, "bad token");
+        }
+
+        const Address addr{sender_.address().to_v4().to_uint(),
+                           implied && *implied ? sender_.port() : static_cast<uint16_t>(port ? *port : 0)};
+        auto& stored = peers_[string{*hash}];
+        const auto now = Clock::now();
+        stored.erase(std::remove_if(stored.begin(), stored.end(), [&](const auto& entry) {
+            return entry.first == addr || now - entry.second >= PEER_LIFETIME;
+        }), stored.end());
+        if (stored.size() < MAX_PEERS_PER_HASH) stored.emplace_back(addr, now);
+        if (peers_.size() > MAX_HASHES) peers_.erase(string{*hash});
+        respond(transaction, std::move(values));
+    } else {
+        error(transaction, 204, "method unknown");
+    }
+}
+
+void Dht::query(const udp::endpoint& endpoint, const string& method, bencode::dict args, Callback callback) {
+    // pick a transaction id that isn't in use
+    auto id = next_transaction_++;
+    while (pending_.count(id) > 0) id = next_transaction_++;
+
+    args["id"] = id_string(table_.id());
+    bencode::dict message;
+    message["t"] = string{static_cast<char>(id >> 8), static_cast<char>(id)};
+    message["y"] = string{"q"};
+    message["q"] = method;
+    message["a"] = std::move(args);
+    send(endpoint, std::move(message));
+
+    // the timer can't remove its own entry while it's running, so expire on the next turn of the loop
+    auto& pending = pending_.try_emplace(id, endpoint, std::move(callback), [this, id] {
+        ba::post(ctx_.io, [this, id] { expire(id); });
+    }).first->second;
+    ctx_.timers->arm(pending.timeout, QUERY_TIMEOUT);
+}
+
+void Dht::expire(uint16_t transaction) {
+    const auto pending = pending_.find(transaction);
+    if (pending == pending_.end() || pending->second.timeout.armed()) return;
+    auto callback = std::move(pending->second.callback);
+    const auto endpoint = pending->second.endpoint;
+    pending_.erase(pending);
+    table_.failed(endpoint);
+    callback(nullptr);
+}
+
+void Dht::respond(const string& transaction, bencode::dict values) {
+    bencode::dict message;
+    message["t"] = transaction;
+    message["y"] = string{"r"};
+    message["r"] = std::move(values);
+    send(sender_, std::move(message));
+}
+
+void Dht::error(const string& transaction, int code, const string& reason) {
+    bencode::dict message;
+    message["t"] = transaction;
+    message["y"] = string{"e"};
+    message["e"] = bencode::list{bencode::integer{code}, reason};
+    send(sender_, std::move(message));
+}
+
+void Dht::send(const udp::endpoint& endpoint, bencode::dict message) {
+    const auto packet = std::make_shared<string>(bencode::encode(message));
+    socket_.async_send_to(ba::buffer(*packet), endpoint, [packet](auto, auto) {});
+}
+
+void Dht::start_lookup() {
+    ctx_.timers->arm(lookup_timer_, ctx_.settings.dht_lookup_interval);
+    if (looking_up_ || nodes() == 0) return;
+    looking_up_ = true;
+    ++lookup_round_;
+    lookup_.clear();
+    lookup_peers_ = 0;
+    in_flight_ = 0;
+
+    for (const auto& node : table_.closest(target_, K)) {
+        add_candidate(node.id, node.endpoint);
+    }
+    step_lookup();
+}
+
+void Dht::add_candidate(const NodeId& id, const udp::endpoint& endpoint) {
+    if (!looking_up_ || id == table_.id()) return;
+    const auto same = [&](const Candidate& candidate) { return candidate.id == id; };
+    if (std::any_of(lookup_.begin(), lookup_.end(), same)) return;
+
+    const auto position = std::find_if(lookup_.begin(), lookup_.end(), [&](const Candidate& candidate) {
+        return RoutingTable::closer(id, candidate.id, target_);
+    });
+    lookup_.insert(position, Candidate{id, endpoint, Candidate::Fresh, {}});
+
+    // far-off nodes we haven't asked yet will never matter
+    while (lookup_.size() > MAX_CANDIDATES && lookup_.back().state == Candidate::Fresh) {
+        lookup_.pop_back();
+    }
+}
+
+void Dht::step_lookup() {
+    // query the closest K nodes that haven't failed, ALPHA at a time
+    size_t considered = 0;
+    for (auto& candidate : lookup_) {
+        if (considered == K || in_flight_ == ALPHA) break;
+        if (candidate.state == Candidate::Failed) continue;
+        ++considered;
+        if (candidate.state != Candidate::Fresh) continue;
+
+        candidate.state = Candidate::Querying;
+        ++in_flight_;
+        bencode::dict args;
+        args["info_hash"] = id_string(target_);
+        query(candidate.endpoint, "get_peers", std::move(args),
+              [this, id = candidate.id, round = lookup_round_](auto response) {
+            if (round == lookup_round_ && looking_up_) on_lookup_response(id, response);
+        });
+    }
+
+    // the closest K have all answered or failed
+    if (in_flight_ == 0) finish_lookup();
+}
+
+void Dht::on_lookup_response(const NodeId& id, const bencode::dict_view* response) {
+    --in_flight_;
+    const auto candidate = std::find_if(lookup_.begin(), lookup_.end(), [&](const auto& c) { return c.id == id; });
+    if (candidate != lookup_.end()) {
+        const auto token = response ? lookup<bencode::string_view>(*response, "token") : nullptr;
+        candidate->state = response ? Candidate::Responded : Candidate::Failed;
+        if (token) candidate->token = string{*token};
+    }
+
+    if (response) {
+        // peers go straight to the connection manager, which ignores ones it already knows
+        const auto values = lookup<bencode::list_view>(*response, "values");
+        if (values) {
+            vector<Address> peers;
+            for (const auto& value : *values) {
+                const auto compact = std::get_if<bencode::string_view>(&value.base());
+                if (compact && compact->size() == 6) peers.emplace_back(compact->data());
+            }
+            lookup_peers_ += peers.size();
+            ctx_.connections->add_candidates(peers);
+        }
+        learn_nodes(*response);
+    }
+    step_lookup();
+}
+
+void Dht::finish_lookup() {
+    looking_up_ = false;
+
+    // announce ourselves to the closest nodes that answered
+    size_t announced = 0;
+    for (const auto& candidate : lookup_) {
+        if (announced == K) break;
+        if (candidate.state != Candidate::Responded || candidate.token.empty()) continue;
+        bencode::dict args;
+        args["info_hash"] = id_string(target_);
+        args["port"] = bencode::integer{port_};
+        args["token"] = candidate.token;
+        args["implied_port"] = bencode::integer{0};
+        query(candidate.endpoint, "announce_peer", std::move(args), [](auto) {});
+        ++announced;
+    }
+    log() << "lookup found " << lookup_peers_ << " peers, announced to " << announced << " nodes ("
+          << nodes() << " in routing table)" << endl;
+    save();
+}
+
+void Dht::learn_nodes(const bencode::dict_view& response) {
+    const auto compact = lookup<bencode::string_view>(response, "nodes");
+    if (!compact) return;
+    for (size_t offset = 0; offset + 26 <= compact->size(); offset += 26) {
+        const auto id = *to_id(compact->substr(offset, 20));
+        const auto endpoint = endpoint_of(compact->data() + offset + 20);
+        if (endpoint.port() == 0) continue;
+        table_.insert(id, endpoint, false);
+        add_candidate(id, endpoint);
+    }
+}
+
+void Dht::rotate_secret() {
+    ctx_.timers->arm(secret_timer_, SECRET_INTERVAL);
+    previous_secret_ = secret_;
+    secret_.resize(16);
+    for (auto& byte : secret_) byte = static_cast<char>(rng_());
+}
+
+string Dht::token_for(const udp::endpoint& endpoint, const string& secret) const {
+    const auto hash = Hash::of(secret + compact_endpoint(endpoint).substr(0, 4)).as_bytes();
+    return string{hash.begin(), hash.begin() + 8};
+}
+
+string Dht::compact_nodes(const NodeId& target) const {
+    string compact;
+    for (const auto& node : table_.closest(target, K)) {
+        compact += id_string(node.id);
+        compact += compact_endpoint(node.endpoint);
+    }
+    return compact;
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include <http.hpp>
+
+static string lowercase(string str) {
+    std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+Url::Url(const string& url) {
+    const auto scheme_end = url.find("://");
+    const auto host_start = scheme_end == string::npos ? 0 : scheme_end + 3;
+    const auto path_start = std::min(url.find('/', host_start), url.size());
+    host = url.substr(host_start, path_start - host_start);
+    service = "80";
+    const auto colon = host.find(':');
+    if (colon != string::npos) {
+        service = host.substr(colon + 1);
+        host.resize(colon);
+    }
+    path = path_start < url.size() ? url.substr(path_start) : "/";
+}
+
+bool HttpParser::feed(const char* data, size_t length) {
+    if (state_ == Error) return false;
+    pending_.append(data, length);
+
+    while (true) {
+        switch (state_) {
+            case Headers:
+                if (!parse_headers()) return state_ != Error;
+                break;
+            case Body:
+            case ChunkData: {
+                const auto taken = std::min(remaining_, pending_.size());
+                if (body_.size() + taken > max_body_) return fail();
+                body_.append(pending_, 0, taken);
+                pending_.erase(0, taken);
+                remaining_ -= taken;
+                if (remaining_ > 0) return true;
+                state_ = state_ == Body ? Done : ChunkEnd;
+                break;
+            }
+            case BodyToEof:
+                if (body_.size() + pending_.size() > max_body_) return fail();
+                body_ += pending_;
+                pending_.clear();
+                return true;
+            case ChunkSize: {
+                const auto end = pending_.find("\r\n");
+                if (end == string::npos) return pending_.size() < MAX_HEADERS || fail();
+                // the size may be followed by extensions, which we don't use
+                char* size_end;
+                remaining_ = std::strtoul(pending_.c_str(), &size_end, 16);
+                if (size_end == pending_.c_str()) return fail();
+                pending_.erase(0, end + 2);
+                // trailers after the last chunk are ignored
+                state_ = remaining_ == 0 ? Done : ChunkData;
+                break;
+            }
+            case ChunkEnd:
+                if (pending_.size() < 2) return true;
+                if (pending_.compare(0, 2, "\r\n") != 0) return fail();
+                pending_.erase(0, 2);
+                state_ = ChunkSize;
+                break;
+            case Done:
+                return true;
+            case Error:
+                return false;
+        }
+    }
+}
+
+void HttpParser::feed_eof() {
+    if (state_ == BodyToEof) {
+        state_ = Done;
+    } else if (state_ != Done) {
+        state_ = Error;
+    }
+}
+
+void HttpParser::reset() {
+    state_ = Headers;
+    pending_.clear();
+    body_.clear();
+    status_ = 0;
+    keep_alive_ = true;
+    remaining_ = 0;
+}
+
+bool HttpParser::parse_headers() {
+    const auto end = pending_.find("\r\n\r\n");
+    if (end == string::npos) {
+        if (pending_.size() > MAX_HEADERS) fail();
+        return false;
+    }
+
+    // status line: HTTP/1.1 200 OK
+    auto line_end = pending_.find("\r\n");
+    if (pending_.compare(0, 5, "HTTP/") != 0) return fail();
+    const auto space = pending_.find(' ');
+    if (space == string::npos || space > line_end) return fail();
+    status_ = std::atoi(pending_.c_str() + space + 1);
+    keep_alive_ = pending_.compare(0, 8, "HTTP/1.0") != 0;
+
+    bool chunked = false;
+    bool has_length = false;
+    size_t length = 0;
+    while (line_end < end) {
+        const auto start = line_end + 2;
+        line_end = pending_.find("\r\n", start);
+        const auto colon = pending_.find(':', start);
+        if (colon == string::npos || colon > line_end) continue;
+
+        const auto name = lowercase(pending_.substr(start, colon - start));
+        auto value_start = colon + 1;
+        while (value_start < line_end && pending_[value_start] == ' ') ++value_start;
+        const auto value = lowercase(pending_.substr(value_start, line_end - value_start));
+
+        if (name == "content-length") {
+            has_length = true;
+            length = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "transfer-encoding") {
+            chunked = value.find("chunked") != string::npos;
+        } else if (name == "connection") {
+            keep_alive_ = value.find("close") == string::npos;
+        }
+    }
+    pending_.erase(0, end + 4);
+
+    if (chunked) {
+        state_ = ChunkSize;
+    } else if (has_length) {
+        if (length > max_body_) return fail();
+        remaining_ = length;
+        state_ = length == 0 ? Done : Body;
+    } else {
+        keep_alive_ = false;
+        state_ = BodyToEof;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+
+#include <connections.hpp>
+#include <listener.hpp>
+#include <message.hpp>
+
+using std::endl;
+
+Listener::Listener(const TorrentContext& ctx, uint16_t port)
+    : ctx_(ctx), acceptor_(ctx.io) {
+    const tcp::endpoint endpoint{tcp::v4(), port};
+    bs::error_code ec;
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec) acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+    if (!ec) acceptor_.bind(endpoint, ec);
+    if (!ec) acceptor_.listen(ba::socket_base::max_listen_connections, ec);
+    if (ec) {
+        log() << "can't listen on port " << port << ": " << ec.message() << endl;
+        acceptor_.close();
+    }
+}
+
+void Listener::start() {
+    if (acceptor_.is_open()) async_accept();
+}
+
+void Listener::async_accept() {
+    acceptor_.async_accept([this](auto ec, tcp::socket socket) {
+        if (ec == ba::error::operation_aborted) return;
+        if (ec) {
+            // errors like running out of file descriptors won't clear up straight away, so don't spin on them
+            log() << "error accepting connection: " << ec.message() << ", retrying in " << backoff_.count() << "ms"
+                  << endl;
+            ctx_.timers->arm(retry_timer_, backoff_);
+            backoff_ = std::min(backoff_ * 2, MAX_BACKOFF);
+            return;
+        }
+        backoff_ = MIN_BACKOFF;
+        async_read_handshake(std::move(socket));
+        async_accept();
+    });
+}
+
+void Listener::async_read_handshake(tcp::socket socket) {
+    const auto pending = std::make_shared<Pending>(std::move(socket));
+    ctx_.timers->arm(pending->timeout, ctx_.settings.connect_timeout);
+
+    // the handshake we receive should be the same length as ours
+    pending->handshake.resize(ctx_.handshake.size());
+    ba::async_read(pending->socket, ba::buffer(pending->handshake), [this, pending](auto ec, auto) {
+        pending->timeout.disarm();
+        if (!ec) on_handshake(pending);
+    });
+}
+
+void Listener::on_handshake(const shared_ptr<Pending>& pending) {
+    bs::error_code ec;
+    const auto remote = pending->socket.remote_endpoint(ec);
+    if (ec || !remote.address().is_v4()) return;
+    const Address addr{remote.address().to_v4().to_uint(), remote.port()};
+
+    // the first byte is the length of the protocol string, which has to match ours
+    if (pending->handshake[0] != ctx_.handshake[0]) {
+        log() << addr.to_string() << " sent an invalid handshake" << endl;
+        return;
+    }
+    Handshake handshake{pending->handshake};
+    if (handshake.info_hash != ctx_.tor.info_hash()) {
+        log() << addr.to_string() << " asked for a torrent we don't have" << endl;
+        return;
+    }
+
+    if (!ctx_.connections->accept(std::move(pending->socket), addr, std::move(handshake))) {
+        log() << "turning away " << addr.to_string() << ": no room" << endl;
+    }
+}
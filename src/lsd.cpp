@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include <connections.hpp>
+#include <lsd.hpp>
+
+using std::endl;
+
+LocalDiscovery::LocalDiscovery(const TorrentContext& ctx, uint16_t port)
+    : ctx_(ctx), port_(port), group_(ba::ip::make_address_v4("239.192.152.143"), 6771), socket_(ctx.io),
+      recv_buffer_(1500) {
+    std::mt19937 rng{std::random_device{}()};
+    cookie_ = std::to_string(rng());
+}
+
+void LocalDiscovery::start() {
+    // other clients on this host listen on the same port, so share it
+    bs::error_code ec;
+    socket_.open(udp::v4(), ec);
+    if (!ec) socket_.set_option(udp::socket::reuse_address(true), ec);
+    if (!ec) socket_.bind(udp::endpoint{udp::v4(), group_.port()}, ec);
+    if (!ec) socket_.set_option(ba::ip::multicast::join_group(group_.address()), ec);
+    if (ec) {
+        log() << "can't join " << group_ << ": " << ec.message() << endl;
+        socket_.close();
+        return;
+    }
+
+    async_receive();
+    announce();
+}
+
+void LocalDiscovery::announce() {
+    ctx_.timers->arm(announce_timer_, ctx_.settings.lsd_interval);
+
+    std::ostringstream message;
+    message << "BT-SEARCH * HTTP/1.1\r\n"
+            << "Host: " << group_ << "\r\n"
+            << "Port: " << port_ << "\r\n"
+            << "Infohash: " << ctx_.tor.info_hash().as_hex() << "\r\n"
+            << "cookie: " << cookie_ << "\r\n"
+            << "\r\n\r\n";
+    const auto packet = std::make_shared<string>(message.str());
+    socket_.async_send_to(ba::buffer(*packet), group_, [packet](auto ec, auto) {
+        if (ec) log() << "error announcing: " << ec.message() << endl;
+    });
+}
+
+void LocalDiscovery::async_receive() {
+    socket_.async_receive_from(ba::buffer(recv_buffer_), sender_, [this](auto ec, auto length) {
+        if (ec == ba::error::operation_aborted) return;
+        if (!ec) on_announce(string{recv_buffer_.data(), length});
+        async_receive();
+    });
+}
+
+void LocalDiscovery::on_announce(const string& message) {
+    std::istringstream lines{message};
+    string line;
+    if (!std::getline(lines, line) || line.rfind("BT-SEARCH * HTTP/1.1", 0) != 0) return;
+
+    // headers are case-insensitive, and there may be one Infohash header per torrent the sender has
+    optional<uint16_t> port;
+    bool ours = false;
+    const auto hash = ctx_.tor.info_hash().as_hex();
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const auto colon = line.find(':');
+        if (colon == string::npos) continue;
+        auto name = line.substr(0, colon);
+        auto value = line.substr(std::min(line.find_first_not_of(' ', colon + 1), line.size()));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+        if (name == "cookie" && value == cookie_) {
+            return;
+        } else if (name == "port") {
+            try {
+                const auto number = std::stoul(value);
+                if (number > 0 && number <= 65535) port = static_cast<uint16_t>(number);
+            } catch (const std::exception&) {
+                return;
+            }
+        } else if (name == "infohash" && value == hash) {
+            ours = true;
+        }
+    }
+    if (!ours || !port) return;
+
+    const Address addr{sender_.address().to_v4().to_uint(), *port};
+    ctx_.connections->add_local(addr);
+}
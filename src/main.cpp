@@ -4,66 +4,110 @@
 #include <boost/asio.hpp>
 #include <boost/lockfree/queue.hpp>
 
+#include <connections.hpp>
+#include <dht.hpp>
 #include <torrent.hpp>
-#include <httprequest.hpp>
+#include <listener.hpp>
+#include <lsd.hpp>
 #include <message.hpp>
 #include <peer.hpp>
+#include <picker.hpp>
+#include <piecetable.hpp>
 #include <result.hpp>
+#include <resume.hpp>
+#include <settings.hpp>
+#include <startup.hpp>
+#include <timerwheel.hpp>
+#include <tracker.hpp>
+#include <upload.hpp>
+#include <webseed.hpp>
 
 const char *tor_file = "../misc/debian.torrent";
 const char *peer_id = "-pt0001-0123456789ab";
 const uint16_t port = 6881;
+const chrono::milliseconds TIMER_RESOLUTION = 50ms;
+const char *dht_state_file = "dht.dat";
+// well-known nodes to join the DHT through when we don't know any from last time
+const vector<std::pair<string, string>> dht_routers{
+    {"router.bittorrent.com", "6881"},
+    {"dht.transmissionbt.com", "6881"},
+    {"router.utorrent.com", "6881"},
+};
 
 using std::make_shared;
-using std::make_unique;
 
-TrackerResponse send_request(const SingleFileTorrent& tor) {
-    cout << tor.filename() << " (" << tor.info_hash().as_hex() << ") @ " << tor.announce() << "\n";
-
-    stringstream request;
-    request << tor.announce() << "?"
-            << "info_hash=" << cmn::urlencode(tor.info_hash().as_bytes()) << "&"
-            << "peer_id=" << peer_id << "&"
-            << "port=" << port << "&"
-            << "uploaded=" << "0" << "&"
-            << "downloaded=" << "0" << "&"
-            << "compact=" << "1" << "&"
-            << "left=" << tor.file_length();
-    cout << "sending request: " << request.str() << "\n";
-    http::Request req{request.str()};
-    const auto response = req.send("GET");
-    return TrackerResponse{string{response.body.begin(), response.body.end()}};
-}
-
-void start_run_connections(const SingleFileTorrent& tor, const TrackerResponse& response) {
-    const auto handshake = Handshake{tor.info_hash(), peer_id}.serialise();
+// everything after loading the torrent overlaps: trackers are asked for peers first, since that takes longest, and
+// peers are dialled as soon as any tracker answers, while the file is preallocated and checked in the background
+void start_run_connections(const SingleFileTorrent& tor, Startup& startup) {
+    const Settings settings;
+    // ut_pex is our only extension
+    const auto handshake = Handshake{tor.info_hash(), peer_id, settings.pex}.serialise();
     ba::io_context io;
 
     // initialise queues
-    const auto work_queue = make_shared<boost::lockfree::queue<uint32_t>>(tor.pieces());
     const auto result_queue = make_shared<boost::lockfree::queue<Result>>(tor.pieces());
 
-    // work_queue initially contains every piece
-    for (uint32_t i = 0; i < tor.pieces(); ++i) {
-        while (!work_queue->push(i));
-    }
+    // the picker initially contains every piece
+    const auto picker = make_shared<PiecePicker>(tor.pieces());
+
+    const auto pieces = make_shared<PieceTable>(tor, picker);
+    const auto timers = make_shared<TimerWheel>(io, TIMER_RESOLUTION);
+    TorrentContext ctx{io, settings, handshake, tor, result_queue, picker, pieces, timers, nullptr, nullptr, startup};
+    ctx.uploads = make_shared<Uploader>(ctx, settings);
 
-    auto peers = make_unique<vector<Peer>>();
-    peers->reserve(response.peers().size());
-    TorrentContext ctx{io, handshake, tor, work_queue, result_queue, response.peers().size()};
-    for (auto& peer_address : response.peers()) {
-        peers->emplace_back(ctx, peer_address);
+    // the connection manager dials cached peers straight away, then peers from trackers as slots allow
+    ctx.connections = make_shared<ConnectionManager>(ctx, settings);
+    ctx.connections->start();
+    cout << tor.filename() << " (" << tor.info_hash().as_hex() << ")\n";
+    Announcer announcer{ctx, peer_id, port};
+    announcer.start();
+
+    // peers can also find us through the tracker or the DHT, on the port we announced
+    Listener listener{ctx, port};
+    Dht dht{ctx, port, dht_state_file};
+    if (settings.dht) dht.start(dht_routers);
+    LocalDiscovery lsd{ctx, port};
+    if (settings.lsd) lsd.start();
+
+    // web seeds download alongside peers, taking pieces from the same picker
+    vector<unique_ptr<WebSeed>> web_seeds;
+    if (settings.web_seeds) {
+        for (const auto& url : tor.web_seeds()) {
+            if (auto seed = WebSeed::create(ctx, url)) {
+                seed->start();
+                web_seeds.push_back(std::move(seed));
+            } else {
+                cout << "[webseed] skipping unsupported web seed: " << url << std::endl;
+            }
+        }
     }
 
-    std::thread monitor{[&ctx, peers = std::move(peers)]() {
-        monitor_thread(ctx, std::move(peers));
+    timers->start();
+    ctx.uploads->start();
+    listener.start();
+    std::thread monitor{[&ctx]() {
+        monitor_thread(ctx);
     }};
+    std::thread resume{[&ctx]() {
+        resume_thread(ctx);
+    }};
+
+    // on the way out, tell the trackers we're leaving so they drop us from the swarm straight away
+    ba::signal_set signals{io, SIGINT, SIGTERM};
+    signals.async_wait([&](auto ec, auto) {
+        if (ec) return;
+        cout << "stopping" << std::endl;
+        announcer.stop([&io] { io.stop(); });
+    });
 
     io.run();
+    // the monitor and resume threads have no way to stop early, so don't wait for them
+    std::exit(EXIT_SUCCESS);
 }
 
 int main() {
+    Startup startup;
     const auto tor = SingleFileTorrent::from_file(tor_file);
-    const auto response = send_request(tor);
-    start_run_connections(tor, response);
+    startup.reached(Startup::TorrentLoaded);
+    start_run_connections(tor, startup);
 }
@@ -94,16 +94,16 @@ string Message::to_string() const {
 }
 
 vector<char> Message::serialize() const {
-    assert(type.has_value());
-    const uint8_t ty = static_cast<char>(*type);
-    const uint32_t len = htonl(payload.size() + 1);
+    vector<char> result;
+    serialize_to(&result);
+    return result;
+}
 
-    stringstream ss;
-    ss.write(reinterpret_cast<const char*>(&len), 4);
-    ss.write(reinterpret_cast<const char*>(&ty), 1);
-    ss.write(payload.data(), static_cast<std::streamsize>(payload.size()));
-    const auto str = ss.str();
-    return vector<char>{str.begin(), str.end()};
+void Message::serialize_to(vector<char>* out) const {
+    assert(type.has_value());
+    cmn::push_bytes(out, htonl(payload.size() + 1));
+    out->push_back(static_cast<char>(*type));
+    out->insert(out->end(), payload.begin(), payload.end());
 }
 
 optional<Message::Type> Message::try_from(uint8_t src) {
@@ -3,12 +3,21 @@
 //
 #include <unordered_set>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include <boost/asio.hpp>
 
 #include <common.hpp>
+#include <connections.hpp>
 #include <peer.hpp>
+#include <piecetable.hpp>
 #include <result.hpp>
+#include <startup.hpp>
+#include <timerwheel.hpp>
 #include <torrent.hpp>
+#include <upload.hpp>
 
 using std::endl;
 using std::ofstream;
@@ -16,12 +25,45 @@ using std::make_shared;
 using std::unordered_set;
 
 Peer::Peer(const TorrentContext& ctx, Address addr)
-        : addr_(addr), socket_(ctx.io), ctx_(ctx)
-{
-    tcp::resolver resolver{ctx.io};
-    auto endpoints = resolver.resolve(addr_.ip(), addr_.port_str());
-    ba::async_connect(socket_, endpoints,
-                      [this](auto ec, auto _) { async_handshake_write(ec); });
+        : addr_(addr), socket_(ctx.io), ctx_(ctx) {}
+
+Peer::Peer(const TorrentContext& ctx, Address addr, tcp::socket socket, const Handshake& handshake)
+        : addr_(addr), ctx_(ctx), socket_(std::move(socket)), peer_id_(handshake.peer_id),
+          extensions_(handshake.extension_protocol()), inbound_(true) {}
+
+void Peer::start() {
+    if (inbound_) {
+        // the peer spoke first, so all that's left is our half of the handshake
+        ctx_.timers->arm(handshake_timer_, ctx_.settings.connect_timeout);
+        ba::async_write(socket_, ba::buffer(ctx_.handshake), [this, self = shared_from_this()](auto ec, auto _) {
+            if (ec.failed()) {
+                log() << "error writing handshake: " << ec.message() << endl;
+                close();
+            } else {
+                on_handshake();
+            }
+        });
+        return;
+    }
+
+    // addresses from the tracker are already numeric, so there's nothing to resolve
+    const tcp::endpoint endpoint{ba::ip::address_v4{addr_.raw}, addr_.port};
+    ctx_.timers->arm(handshake_timer_, ctx_.settings.connect_timeout);
+    socket_.async_connect(endpoint, [this, self = shared_from_this()](auto ec) { async_handshake_write(ec); });
+}
+
+void Peer::close() {
+    if (closed_) return;
+    closed_ = true;
+    if (!am_choking_) ctx_.uploads->release_slot();
+    upload_queue_.clear();
+    ctx_.picker->remove_peer(available_pieces_);
+    keepalive_timer_.disarm();
+    handshake_timer_.disarm();
+    release_requests();
+    socket_.close();
+    while (!ctx_.result_queue->push(ResultPeerDropped{addr_}));
+    ctx_.connections->on_closed(addr_);
 }
 
 void Peer::async_handshake_write(const bs::error_code &ec) {
@@ -32,7 +74,7 @@ void Peer::async_handshake_write(const bs::error_code &ec) {
     }
 
     ba::async_write(socket_, ba::buffer(ctx_.handshake),
-                    [this](auto ec, auto _) { async_handshake_read(ec); });
+                    [this, self = shared_from_this()](auto ec, auto _) { async_handshake_read(ec); });
 }
 
 void Peer::async_handshake_read(const bs::error_code &ec) {
@@ -45,7 +87,7 @@ void Peer::async_handshake_read(const bs::error_code &ec) {
     // handshake we receive back should be the same length as ours
     recv_buffer_.resize(ctx_.handshake.size());
     ba::async_read(socket_, ba::buffer(recv_buffer_),
-                   [this](auto ec, auto _) { async_next(ec); });
+                   [this, self = shared_from_this()](auto ec, auto _) { async_next(ec); });
 }
 
 void Peer::async_next(const bs::error_code &ec) {
@@ -57,10 +99,28 @@ void Peer::async_next(const bs::error_code &ec) {
 
     const Handshake result{recv_buffer_};
     peer_id_ = std::move(result.peer_id);
-    log() << "successfully connected (" << addr_.to_string() << ")" << endl;
+    extensions_ = result.extension_protocol();
+    on_handshake();
+}
+
+void Peer::on_handshake() {
+    log() << "successfully connected (" << addr_.to_string() << (inbound_ ? ", inbound" : "") << ")" << endl;
+    handshake_timer_.disarm();
+    ctx_.startup.reached(Startup::PeerConnected);
+    connected_ = true;
+    ctx_.connections->on_connected(addr_);
     while (!ctx_.result_queue->push(ResultPeerConnected{addr_}));
+    ctx_.timers->arm(keepalive_timer_, KEEPALIVE_INTERVAL);
 
-    async_write_message(Message::interested());
+    // the bitfield has to be the first message after the handshake, if we send one at all
+    const auto& have = ctx_.pieces->have();
+    if (have.any()) {
+        async_write_message(Message::bitfield(have));
+    }
+    // only if we offered the extension protocol too
+    if (extensions_ && ctx_.settings.pex) send_extended_handshake();
+
+    // we'll send Interested once the peer tells us it has something we want
     async_read_message();
 }
 
@@ -68,7 +128,7 @@ void Peer::async_read_message() {
     // first handle_message the message length
     recv_buffer_.resize(sizeof(uint32_t));
     ba::async_read(socket_, ba::buffer(recv_buffer_),
-                   [this](auto ec, auto _) { async_read_len(ec); });
+                   [this, self = shared_from_this()](auto ec, auto _) { async_read_len(ec); });
 }
 
 void Peer::async_read_len(const bs::error_code &ec) {
@@ -85,10 +145,10 @@ void Peer::async_read_len(const bs::error_code &ec) {
     } else {
         recv_buffer_.resize(len);
         ba::async_read(socket_, ba::buffer(recv_buffer_),
-           [this](auto ec, auto _) {
+           [this, self = shared_from_this()](auto ec, auto _) {
                if (ec.failed()) {
                    if (!closed_) log() << "error reading message: " << ec.message() << endl;
-                   release_piece();
+                   close();
                } else {
                    async_handle_message();
                }
@@ -97,50 +157,135 @@ void Peer::async_read_len(const bs::error_code &ec) {
 }
 
 void Peer::handle_piece(const Message& msg) {
-    if (!piece_) return;
+    auto& table = *ctx_.pieces;
+    const auto [result, index, block, length, duplicates] = table.accept(msg.payload, addr_, this);
+    const auto request = requests_.find(BlockRef::key_of(index, block));
+    if (request != requests_.end()) {
+        on_block_received(request->second, length);
+    }
+    release_block(BlockRef::key_of(index, block));
+
+    // in endgame, anyone else we asked for this block should stop sending it
+    for (const auto peer : duplicates) {
+        peer->cancel(index, block);
+    }
 
-    const auto [result, index] = piece_->accept(msg.payload);
-    release_block(index);
+    if (result == BlockStatus::AlreadyFilled || result == BlockStatus::WrongPiece) {
+        while (!ctx_.result_queue->push(ResultBytesWasted{length}));
+    } else if (result == BlockStatus::Ok) {
+        ctx_.startup.reached(Startup::FirstBlock);
+    }
 
     if (result != BlockStatus::Ok) {
         // this happens a lot due to pipelined piece requests (receive block for piece we already finished)
         if (result != BlockStatus::WrongPiece && result != BlockStatus::AlreadyFilled) {
             log() << "error accepting block: " << block_status_string(result) << endl;
         }
-    } else if (piece_->is_complete()) {
-        const auto final_piece = piece_->finalize();
-        blocks_.clear();
-        const auto hash = final_piece.hash();
-        if (hash == ctx_.tor.piece_hash(piece_->index())) {
+    } else if (table.is_complete(index)) {
+        const auto blame = table.single_source(index);
+        const auto final_piece = table.take_complete(index);
+        if (final_piece.hash() == ctx_.tor.piece_hash(index)) {
+            // the monitor tells the connection manager once it's on disk
             while (!ctx_.result_queue->push(ResultPieceComplete{final_piece}));
         } else {
-            if (!closed_) log() << "piece " << piece_->index() << ": failed hash check, dropping peer" << endl;
-            close();
-            return;
+            auto piece = final_piece;
+            piece.free();
+            table.requeue(index);
+            // only drop the peer if we know the bad data came from it
+            if (blame) {
+                if (!closed_) log() << "piece " << index << ": failed hash check, dropping peer" << endl;
+                close();
+            } else {
+                log() << "piece " << index << ": failed hash check" << endl;
+            }
         }
-        piece_.reset();
     }
 }
 
+void Peer::handle_have(const Message& msg) {
+    if (msg.payload.size() < 4) return;
+    const uint32_t index = ntohl(*reinterpret_cast<const uint32_t*>(msg.payload.data()));
+    if (index >= ctx_.tor.pieces() || available_pieces_.get(index)) return;
+    available_pieces_.set(index);
+    ctx_.picker->add_have(index);
+
+    if (!ctx_.pieces->have().get(index)) {
+        ++wanted_;
+        update_interest();
+    }
+}
+
+void Peer::handle_bitfield(const Message& msg) {
+    ctx_.picker->remove_peer(available_pieces_);
+    available_pieces_.copy_from(msg.payload);
+    // drop any spare bits at the end
+    available_pieces_.resize(ctx_.tor.pieces());
+    ctx_.picker->add_peer(available_pieces_);
+
+    wanted_ = available_pieces_.count_and_not(ctx_.pieces->have());
+    update_interest();
+}
+
+void Peer::on_piece_completed(uint32_t index) {
+    if (available_pieces_.get(index)) {
+        --wanted_;
+        update_interest();
+    }
+}
+
+void Peer::update_interest() {
+    if (closed_) return;
+    const auto interested = wanted_ > 0;
+    if (interested == interested_) return;
+    interested_ = interested;
+    async_write_message(interested ? Message::interested() : Message::not_interested());
+}
+
 void Peer::async_handle_message() {
     const Message msg{recv_buffer_};
     if (!msg.type) {
+        // skip anything we don't understand
+        async_read_message();
         return;
     }
 
     switch (*msg.type) {
         case Message::Choke:
+            // the peer won't answer our outstanding requests, so let other peers have them right away. any blocks
+            // it already delivered stay in the piece table
             choked_ = true;
+            if (!requests_.empty()) {
+                release_requests();
+                ctx_.connections->blocks_released();
+            }
             break;
         case Message::Unchoke:
             choked_ = false;
             break;
+        case Message::Have:
+            handle_have(msg);
+            break;
+        case Message::Interested:
+            handle_interested(true);
+            break;
+        case Message::NotInterested:
+            handle_interested(false);
+            break;
+        case Message::Request:
+            handle_request(msg);
+            break;
+        case Message::Cancel:
+            handle_cancel(msg);
+            break;
         case Message::Bitfield:
-            available_pieces_.copy_from(msg.payload);
+            handle_bitfield(msg);
             break;
         case Message::Piece:
             handle_piece(msg);
             break;
+        case Message::Extension:
+            handle_extension(msg);
+            break;
         default:
             break;
     }
@@ -148,57 +293,368 @@ void Peer::async_handle_message() {
     async_read_message();
 }
 
+void Peer::send_extended_handshake() {
+    bencode::dict extensions;
+    if (ctx_.settings.pex) extensions["ut_pex"] = bencode::integer{PEX_ID};
+    bencode::dict handshake;
+    handshake["m"] = std::move(extensions);
+    handshake["v"] = string{"picotor"};
+    async_write_message(Message::extended(Message::EXTENDED_HANDSHAKE, bencode::encode(handshake)));
+}
+
+void Peer::handle_extension(const Message& msg) {
+    if (msg.payload.empty()) return;
+    const auto id = static_cast<uint8_t>(msg.payload[0]);
+    try {
+        const auto dict = std::get<bencode::dict_view>(
+                bencode::decode_view(string_view{msg.payload.data() + 1, msg.payload.size() - 1}));
+        if (id == Message::EXTENDED_HANDSHAKE) {
+            // the peer's ids for the extensions it supports; a missing or zero id means it doesn't (or no longer does)
+            const auto m = dict.find("m");
+            if (m == dict.end()) return;
+            const auto& extensions = std::get<bencode::dict_view>(m->second);
+            const auto pex = extensions.find("ut_pex");
+            const auto pex_id = pex == extensions.end() ? 0 : std::get<bencode::integer_view>(pex->second);
+            pex_id_ = pex_id > 0 && pex_id < 256 ? static_cast<uint8_t>(pex_id) : 0;
+        } else if (id == PEX_ID && ctx_.settings.pex) {
+            handle_pex(dict);
+        }
+    } catch (const std::exception& e) {
+        log() << "invalid extension message: " << e.what() << endl;
+    }
+}
+
+void Peer::handle_pex(const bencode::dict_view& pex) {
+    // peers are only supposed to send these once a minute; ignore any that come too soon
+    const auto now = chrono::steady_clock::now();
+    if (last_pex_received_ && now - *last_pex_received_ < MIN_PEX_INTERVAL) return;
+    last_pex_received_ = now;
+
+    // the connection manager ignores peers it already knows. dropped peers are left alone, since they may just
+    // have disconnected from this one
+    const auto added = pex.find("added");
+    if (added == pex.end()) return;
+    const auto& compact = std::get<bencode::string_view>(added->second);
+    vector<Address> peers;
+    for (size_t offset = 0; offset + 6 <= compact.size() && peers.size() < MAX_PEX_PEERS; offset += 6) {
+        const Address addr{compact.data() + offset};
+        if (addr.port != 0) peers.push_back(addr);
+    }
+    ctx_.connections->add_candidates(peers);
+}
+
+void Peer::send_pex(const vector<Address>& connected) {
+    if (closed_ || !connected_ || pex_id_ == 0) return;
+
+    // the first message has (up to MAX_PEX_PEERS of) everyone, later ones only what changed since
+    const std::unordered_set<Address> current{connected.begin(), connected.end()};
+    string dropped;
+    for (auto it = pex_sent_.begin(); it != pex_sent_.end() && dropped.size() < 6 * MAX_PEX_PEERS;) {
+        if (current.count(*it) > 0) {
+            ++it;
+        } else {
+            dropped += it->to_bytes();
+            it = pex_sent_.erase(it);
+        }
+    }
+    string added;
+    for (const auto& addr : connected) {
+        if (added.size() == 6 * MAX_PEX_PEERS) break;
+        if (addr == addr_ || !pex_sent_.insert(addr).second) continue;
+        added += addr.to_bytes();
+    }
+    if (added.empty() && dropped.empty()) return;
+
+    bencode::dict pex;
+    pex["added"] = added;
+    // no flags: we don't know whether they prefer encryption or are seeds
+    pex["added.f"] = string(added.size() / 6, '\0');
+    pex["dropped"] = dropped;
+    async_write_message(Message::extended(pex_id_, bencode::encode(pex)));
+}
+
 void Peer::async_download() {
-    while (blocks_.size() < PIPELINE_LIMIT) {
+    while (requests_.size() < pipeline_limit()) {
         // make sure we can actually download something first
-        if (choked_ || available_pieces_.size() == 0) return;
-
-        if (!piece_) {
-            // find a piece to download; yield if we don't succeed right away, to prevent infinite loops
-            uint32_t index;
-            if (!ctx_.work_queue->pop(index)) return;
-
-            piece_ = Piece{index, ctx_.tor.piece_size()};
-            // if we got a piece that's not available from this peer, put it back in the queue and give up
-            if (!available_pieces_.get(index)) {
-                release_piece();
-                return;
-            }
+        if (closed_ || choked_ || wanted_ == 0) return;
+
+        // find a block to download, possibly from a piece another peer is also working on
+        const auto was_endgame = ctx_.pieces->endgame();
+        const auto ref = ctx_.pieces->reserve(available_pieces_, this);
+        if (!was_endgame && ctx_.pieces->endgame()) {
+            while (!ctx_.result_queue->push(ResultEndgame{}));
         }
+        if (!ref) return;
+        const auto block = ref->block;
 
-        // no point starting a block for a complete piece
-        if (piece_->is_complete()) return;
+        // at this point, we have committed to a block; start the deadline
+        const auto key = ref->key();
+        // the timer can't release its own request while it's running, so time out on the next turn of the loop
+        auto& request = requests_.try_emplace(key, *ref, [this, key] {
+            ba::post(ctx_.io, [self = shared_from_this(), key] { self->on_request_timeout(key); });
+        }).first->second;
+        ctx_.timers->arm(request.deadline, request_timeout());
 
-        // find a block to download
-        const auto block = piece_->next_block();
-        if (!block) return;
-        blocks_.emplace(block->index(), block);
+        // request the block
+        const auto piece_index = ref->piece;
+        const auto msg = Message::request(piece_index, ctx_.tor.piece_size(piece_index), *block);
+        async_write_message(msg);
+    }
+}
 
-        // at this point, we have committed to a block; start a timer
-        const auto timer = make_shared<ba::steady_timer>(ctx_.io, TIMEOUT_MS);
-        timer->async_wait([timer, block, this](auto ec) {
-            if (ec.failed()) {
-                log() << "error in block timeout: " << ec.message() << endl;
-                return;
-            }
-            // give up on this peer
-            if (!block->filled()) {
-                if (!closed_) log() << "timed out, dropping peer" << endl;
-                closed_ = true;
-                close();
-            }
-        });
+void Peer::on_request_timeout(uint64_t key) {
+    const auto request = requests_.find(key);
+    // the request may have been released and made again since the timer fired
+    if (request == requests_.end() || request->second.deadline.armed()) return;
 
-        // request the block
-        const auto msg = Message::request(*piece_, *block);
-        async_write_message(msg, [block, this](auto ec, auto _) {
-            if (ec.failed()) {
-                log() << "failed receiving piece " << piece_->index() << ", block " << block->index() << ": "
-                      << ec.message() << endl;
-                release_block(block->index());
-            }
-        });
+    // someone else delivered the block; just free up the slot
+    if (request->second.ref.block->filled()) {
+        release_block(key);
+        async_download();
+        return;
     }
+
+    // only reconnecting is expensive; a peer that keeps timing out without sending anything is probably gone
+    if (++timeouts_ >= MAX_TIMEOUTS) {
+        if (!closed_) log() << "timed out " << timeouts_ << " times, dropping peer" << endl;
+        close();
+        return;
+    }
+
+    // otherwise hand its blocks to someone else, and back off from this peer until it delivers again. anything it
+    // sends late is still accepted
+    if (!snubbed_) {
+        log() << "snubbed (rtt " << srtt_.value_or(0) << "ms, " << download_rate_.rate() / 1024 << "kB/s)" << endl;
+    }
+    snubbed_ = true;
+    release_requests();
+    ctx_.connections->blocks_released();
+}
+
+void Peer::on_block_received(const Request& request, uint32_t length) {
+    const auto now = chrono::steady_clock::now();
+    download_rate_.add(length, now);
+    timeouts_ = 0;
+    snubbed_ = false;
+
+    // RFC 6298 estimator; the sample includes time spent queued behind our other requests, which is what we want
+    const auto sample = chrono::duration<double, std::milli>(now - request.sent).count();
+    if (!srtt_) {
+        srtt_ = sample;
+        rttvar_ = sample / 2;
+    } else {
+        rttvar_ = 0.75 * rttvar_ + 0.25 * std::abs(*srtt_ - sample);
+        srtt_ = 0.875 * *srtt_ + 0.125 * sample;
+    }
+}
+
+chrono::milliseconds Peer::request_timeout() const {
+    const auto base = srtt_ ? chrono::milliseconds{static_cast<int64_t>(*srtt_ + 4 * rttvar_)} : INITIAL_TIMEOUT;
+    // back off exponentially while the peer keeps timing out
+    return std::clamp(base * (1 << timeouts_), MIN_TIMEOUT, MAX_TIMEOUT);
+}
+
+uint32_t Peer::pipeline_limit() {
+    if (snubbed_) return 1;
+    const auto rate = download_rate_.rate();
+    if (rate == 0) return INITIAL_PIPELINE;
+    const auto target = rate * chrono::duration<double>(PIPELINE_TARGET).count() / BLOCK_SIZE;
+    return std::clamp(static_cast<uint32_t>(target), 2u, MAX_PIPELINE);
+}
+
+void Peer::send_keepalive() {
+    // zero length means keepalive message
+    outbox().insert(outbox().end(), sizeof(uint32_t), 0);
+    async_flush();
+}
+
+void Peer::async_flush() {
+    if (closed_ || writing_ || outbox_.empty()) return;
+
+    // anything we send counts as a keepalive
+    ctx_.timers->arm(keepalive_timer_, KEEPALIVE_INTERVAL);
+
+    sending_.swap(outbox_);
+    outbox_.clear();
+    sending_file_ = outbox_file_;
+    outbox_file_.reset();
+    // messages queued behind the file range go out in the next write
+    outbox_.swap(after_file_);
+    writing_ = true;
+    ba::async_write(socket_, ba::buffer(sending_), [this, self = shared_from_this()](auto ec, auto _) {
+        if (ec.failed()) {
+            writing_ = false;
+            if (!closed_) log() << "error writing: " << ec.message() << endl;
+            close();
+            return;
+        }
+        // block data for a Piece message goes straight from the file after its header
+        if (sending_file_) {
+            async_sendfile();
+        } else {
+            finish_write();
+        }
+    });
+}
+
+void Peer::finish_write() {
+    writing_ = false;
+    schedule_upload();
+    async_flush();
+}
+
+void Peer::async_sendfile() {
+#ifdef __linux__
+    auto& range = *sending_file_;
+    const auto fd = ctx_.uploads->file_fd();
+    socket_.native_non_blocking(true);
+    while (range.length > 0) {
+        auto offset = static_cast<off_t>(range.offset);
+        const auto n = ::sendfile(socket_.native_handle(), fd, &offset, range.length);
+        if (n > 0) {
+            range.offset += n;
+            range.length -= n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // socket buffer is full; carry on when there's room
+            socket_.async_wait(tcp::socket::wait_write, [this, self = shared_from_this()](auto ec) {
+                if (ec.failed()) {
+                    writing_ = false;
+                    close();
+                    return;
+                }
+                async_sendfile();
+            });
+            return;
+        } else {
+            // a short file means we told the peer we had something we don't
+            writing_ = false;
+            if (!closed_) log() << "error sending file data: " << (n < 0 ? strerror(errno) : "end of file") << endl;
+            close();
+            return;
+        }
+    }
+#endif
+    sending_file_.reset();
+    finish_write();
+}
+
+void Peer::announce(const vector<uint32_t>& pieces) {
+    if (closed_ || !connected_) return;
+    for (const auto index : pieces) {
+        if (!available_pieces_.get(index)) {
+            Message::have(index).serialize_to(&outbox());
+        }
+    }
+    async_flush();
+}
+
+void Peer::cancel(uint32_t piece, uint32_t block) {
+    const auto key = BlockRef::key_of(piece, block);
+    const auto request = requests_.find(key);
+    if (request == requests_.end()) return;
+
+    async_write_message(Message::cancel(piece, ctx_.tor.piece_size(piece), *request->second.ref.block));
+    release_block(key);
+    async_download();
+}
+
+void Peer::handle_interested(bool interested) {
+    peer_interested_ = interested;
+    // the choker sorts out who deserves a slot; until then, interested peers can have any that are free
+    if (interested && ctx_.uploads->has_free_slot()) {
+        set_choking(false);
+    } else if (!interested) {
+        set_choking(true);
+    }
+}
+
+void Peer::set_choking(bool choking) {
+    if (closed_ || !connected_ || choking == am_choking_) return;
+    am_choking_ = choking;
+    if (choking) {
+        ctx_.uploads->release_slot();
+        // choking discards every request the peer had queued
+        upload_queue_.clear();
+        async_write_message(Message::choke());
+    } else {
+        ctx_.uploads->take_slot();
+        async_write_message(Message::unchoke());
+    }
+}
+
+static optional<UploadRequest> parse_block_request(const Message& msg) {
+    if (msg.payload.size() != 12) return std::nullopt;
+    const auto fields = reinterpret_cast<const uint32_t*>(msg.payload.data());
+    return UploadRequest{ntohl(fields[0]), ntohl(fields[1]), ntohl(fields[2])};
+}
+
+void Peer::handle_request(const Message& msg) {
+    const auto request = parse_block_request(msg);
+    if (!request || am_choking_) return;
+
+    // only serve whole, in-bounds blocks of pieces we have on disk
+    const auto [index, offset, length] = *request;
+    if (index >= ctx_.tor.pieces() || !ctx_.pieces->have().get(index)
+            || length == 0 || length > BLOCK_SIZE
+            || static_cast<uint64_t>(offset) + length > ctx_.tor.piece_size(index)) {
+        log() << "ignoring invalid request for piece " << index << ", " << offset << "+" << length << endl;
+        return;
+    }
+
+    if (upload_queue_.size() >= ctx_.settings.max_upload_queue) return;
+    upload_queue_.push_back(*request);
+    schedule_upload();
+}
+
+void Peer::handle_cancel(const Message& msg) {
+    const auto request = parse_block_request(msg);
+    if (!request) return;
+    const auto it = std::find(upload_queue_.begin(), upload_queue_.end(), *request);
+    if (it != upload_queue_.end()) upload_queue_.erase(it);
+}
+
+void Peer::schedule_upload() {
+    if (upload_scheduled_ || closed_ || upload_queue_.empty()) return;
+    // wait for the send buffer to drain before taking another turn
+    if (outbox_.size() >= ctx_.settings.upload_buffer) return;
+    upload_scheduled_ = true;
+    ctx_.uploads->ready(shared_from_this());
+}
+
+bool Peer::serve_next() {
+    upload_scheduled_ = false;
+    if (closed_ || am_choking_ || upload_queue_.empty()) return false;
+
+    // with zero-copy, the data follows its header straight from the file, so only one block can be queued at a time
+    if (outbox_file_) return false;
+    const auto zero_copy = ctx_.uploads->can_sendfile();
+
+    const auto request = upload_queue_.front();
+    upload_queue_.pop_front();
+
+    // write the Piece message header into the send buffer: length, type, index, offset
+    const auto start = outbox_.size();
+    cmn::push_bytes(&outbox_, htonl(9 + request.length));
+    outbox_.push_back(static_cast<char>(Message::Piece));
+    cmn::push_bytes(&outbox_, htonl(request.piece));
+    cmn::push_bytes(&outbox_, htonl(request.offset));
+    if (zero_copy) {
+        ctx_.uploads->prefetch(request);
+        outbox_file_ = FileRange{ctx_.uploads->file_offset(request), request.length};
+    } else if (!ctx_.uploads->read_block(request, &outbox_)) {
+        outbox_.resize(start);
+        log() << "failed reading piece " << request.piece << " from disk" << endl;
+        return !upload_queue_.empty();
+    }
+    upload_rate_.add(request.length);
+    ctx_.uploads->count(request.length);
+    async_flush();
+
+    if (upload_queue_.empty() || outbox_.size() >= ctx_.settings.upload_buffer || outbox_file_) return false;
+    upload_scheduled_ = true;
+    return true;
 }
 
 typedef chrono::time_point<chrono::system_clock> Timepoint;
@@ -206,10 +662,10 @@ typedef chrono::time_point<chrono::system_clock> Timepoint;
 class MonitorVisitor {
 public:
     explicit MonitorVisitor(const TorrentContext& ctx)
-        : ctx_(ctx), stream_(ofstream{ctx.tor.filename()}) {
-        for (size_t i = 0; i < ctx_.tor.file_length(); ++i) {
-            stream_.put(0);
-        }
+        : ctx_(ctx) {
+        // keep whatever a previous run left in the file; the resume check preallocates it and finds complete pieces
+        { ofstream create{ctx.tor.filename(), std::ios::app}; }
+        stream_.open(ctx.tor.filename(), std::ios::in | std::ios::out | std::ios::binary);
 
         for (uint32_t i = 0; i < ctx_.tor.pieces(); ++i) {
             missing_pieces_.insert(i);
@@ -223,6 +679,13 @@ public:
         stream_.seekp(result.piece.offset());
         stream_.write(result.piece.data(), result.piece.size());
 
+        stream_.flush();
+
+        // now peers can have it
+        ba::post(ctx_.io, [&ctx = ctx_, index = result.piece.index()] {
+            ctx.connections->piece_completed(index);
+        });
+
         // update piece tracking
         result.piece.free();
         missing_pieces_.erase(result.piece.index());
@@ -238,20 +701,28 @@ public:
         }
     }
 
+    void operator()(ResultPieceResumed result) {
+        if (missing_pieces_.erase(result.index) > 0) {
+            bytes_resumed_ += ctx_.tor.piece_size(result.index);
+        }
+    }
+
     void report_progress() {
         last_report_ = now_;
         const auto duration = chrono::duration_cast<chrono::milliseconds>(now_ - start_).count();
         elapsed_ = static_cast<double>(duration) / 1000;
 
         const auto downloaded = bytes_downloaded_ / 1024;
-        const auto percent = downloaded / (static_cast<double>(ctx_.tor.file_length()) / 1024);
+        const auto percent = downloaded / ((static_cast<double>(ctx_.tor.file_length()) - bytes_resumed_) / 1024);
         const auto est_duration = elapsed_ / percent;
         log() << (ctx_.tor.pieces() - missing_pieces_.size()) << "/" << ctx_.tor.pieces()
               << " pieces complete in "
               << elapsed_ << " sec., "
               << downloaded / elapsed_ << "kB/s, "
               << (missing_pieces_.empty() ? 0 : est_duration - elapsed_) << " sec. remaining, from "
-              << peers_.size() << "/" << ctx_.total_peers << " peers"
+              << peers_.size() << "/" << ctx_.connections->known() << " peers, "
+              << ctx_.uploads->uploaded() / 1024 << "kB uploaded ("
+              << ctx_.uploads->cache().hits() << " cache hits, " << ctx_.uploads->cache().misses() << " misses)"
               << endl;
 
         // TODO: cool visualisation?
@@ -272,11 +743,25 @@ public:
         peers_.erase(result.addr);
     }
 
+    void operator()(ResultEndgame) {
+        endgame_start_ = chrono::system_clock::now();
+        log() << "entering endgame with " << missing_pieces_.size() << " pieces missing" << endl;
+    }
+
+    void operator()(ResultBytesWasted result) {
+        bytes_wasted_ += result.bytes;
+    }
+
     ~MonitorVisitor() {
         log() << "download complete in "
               << elapsed_ << " sec. (" << (static_cast<double>(ctx_.tor.file_length()) / (1024 * 1024)) / elapsed_
               << "MB/s)!"
               << std::endl;
+        if (endgame_start_) {
+            const auto endgame = chrono::duration_cast<chrono::milliseconds>(now_ - *endgame_start_).count();
+            log() << "endgame took " << static_cast<double>(endgame) / 1000 << " sec., "
+                  << bytes_wasted_ / 1024 << "kB wasted on duplicate blocks" << endl;
+        }
     }
 
 private:
@@ -290,11 +775,14 @@ private:
     double elapsed_ = 0;
     Timepoint last_report_ = start_;
     double bytes_downloaded_ = 0;
+    double bytes_resumed_ = 0;
+    optional<Timepoint> endgame_start_;
+    double bytes_wasted_ = 0;
 
     static ostream& log() { return std::cout << "[monitor] "; }
 };
 
-void monitor_thread(const TorrentContext& ctx, const unique_ptr<vector<Peer>>&& peers) {
+void monitor_thread(const TorrentContext& ctx) {
     MonitorVisitor monitor{ctx};
 
     while (!monitor.complete()) {
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <peercache.hpp>
+
+// on disk: magic, entry count, then fixed-size entries in host byte order. it never leaves this machine
+namespace {
+    struct Record {
+        uint32_t ip;
+        uint16_t port;
+        uint64_t last_seen;
+        float rate;
+        uint32_t failures;
+    } __attribute__((packed));
+}
+
+uint64_t PeerCache::now() {
+    const auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+}
+
+double PeerCache::score(const Entry& entry, uint64_t now) {
+    const auto age_days = static_cast<double>(now - std::min(now, entry.last_seen)) / DAY;
+    // peers we've never had data from still beat ones we've never reached
+    return (entry.rate + 1) * std::exp2(-age_days) / (1 + entry.failures);
+}
+
+vector<Address> PeerCache::load() {
+    std::ifstream file{path_, std::ios::binary};
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file || magic != MAGIC) return {};
+
+    const auto time = now();
+    Record record{};
+    for (uint32_t i = 0; i < count && file.read(reinterpret_cast<char*>(&record), sizeof(record)); ++i) {
+        if (time - std::min(time, record.last_seen) > MAX_AGE || record.failures >= MAX_FAILURES) continue;
+        entries_.insert_or_assign(Address{record.ip, record.port},
+                                  Entry{record.last_seen, record.rate, record.failures});
+    }
+
+    vector<std::pair<double, Address>> ranked;
+    ranked.reserve(entries_.size());
+    for (const auto& [addr, entry] : entries_) {
+        ranked.emplace_back(score(entry, time), addr);
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+    vector<Address> peers;
+    peers.reserve(ranked.size());
+    for (const auto& [_, addr] : ranked) {
+        peers.push_back(addr);
+    }
+    return peers;
+}
+
+void PeerCache::save() const {
+    // keep the best entries if there are too many
+    const auto time = now();
+    vector<std::pair<double, Record>> ranked;
+    ranked.reserve(entries_.size());
+    for (const auto& [addr, entry] : entries_) {
+        if (time - std::min(time, entry.last_seen) > MAX_AGE || entry.failures >= MAX_FAILURES) continue;
+        ranked.emplace_back(score(entry, time), Record{addr.raw, addr.port, entry.last_seen, entry.rate, entry.failures});
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+    ranked.resize(std::min(ranked.size(), MAX_ENTRIES));
+
+    // write a temporary file and rename it over the old one, so a crash can't leave it half-written
+    const auto temp = path_ + ".tmp";
+    {
+        std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+        const uint32_t count = ranked.size();
+        file.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& [_, record] : ranked) {
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+        if (!file) return;
+    }
+    std::rename(temp.c_str(), path_.c_str());
+}
+
+void PeerCache::connected(const Address& addr) {
+    auto& entry = entries_.try_emplace(addr, Entry{0, 0, 0}).first->second;
+    entry.last_seen = now();
+    entry.failures = 0;
+}
+
+void PeerCache::seen(const Address& addr, double rate) {
+    auto& entry = entries_.try_emplace(addr, Entry{0, 0, 0}).first->second;
+    entry.last_seen = now();
+    if (rate > 0) entry.rate = static_cast<float>(rate);
+}
+
+void PeerCache::failed(const Address& addr) {
+    // peers we've never reached aren't worth remembering; they age out straight away
+    ++entries_.try_emplace(addr, Entry{0, 0, 0}).first->second.failures;
+}
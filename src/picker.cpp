@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include <picker.hpp>
+
+PiecePicker::PiecePicker(uint32_t pieces)
+    : order_(pieces), position_(pieces), availability_(pieces, 0), level_start_{0}, queued_(pieces) {
+    for (uint32_t i = 0; i < pieces; ++i) {
+        order_[i] = i;
+        queued_.set(i);
+    }
+    std::shuffle(order_.begin(), order_.end(), rng_);
+    for (uint32_t i = 0; i < pieces; ++i) {
+        position_[order_[i]] = i;
+    }
+}
+
+void PiecePicker::add_peer(const Bitfield& available) {
+    const auto end = std::min(available.size(), availability_.size());
+    for (auto i = available.find_next(0); i < end; i = available.find_next(i + 1)) {
+        increment(i);
+    }
+}
+
+void PiecePicker::remove_peer(const Bitfield& available) {
+    const auto end = std::min(available.size(), availability_.size());
+    for (auto i = available.find_next(0); i < end; i = available.find_next(i + 1)) {
+        decrement(i);
+    }
+}
+
+void PiecePicker::add_have(uint32_t index) {
+    if (index < availability_.size()) increment(index);
+}
+
+optional<uint32_t> PiecePicker::pick(const Bitfield& available) {
+    // word-parallel check that the peer has anything we still want
+    if (!available.any_and(queued_)) return std::nullopt;
+
+    // usually one of the first few of the rarest pieces will do. pieces nobody has sit at the front; skip them
+    const auto start = level_start_.size() > 1 ? level_start_[1] : static_cast<uint32_t>(order_.size());
+    const auto end = static_cast<uint32_t>(std::min<size_t>(order_.size(), start + SCAN_LIMIT));
+    for (auto pos = start; pos < end; ++pos) {
+        const auto index = order_[pos];
+        if (available.get(index)) {
+            remove(index);
+            return index;
+        }
+    }
+
+    // otherwise the peer only has common pieces: walk the pieces it has that we want, a word at a time, and take the
+    // one earliest in the order (lowest availability, then random)
+    auto best = NOT_QUEUED;
+    const auto last = std::min(available.size(), queued_.size());
+    for (auto i = available.find_next_and(queued_, 0); i < last; i = available.find_next_and(queued_, i + 1)) {
+        if (best == NOT_QUEUED || position_[i] < position_[best]) best = i;
+    }
+    remove(best);
+    return best;
+}
+
+void PiecePicker::requeue(uint32_t index) {
+    if (position_[index] != NOT_QUEUED) return;
+    const auto level = availability_[index];
+    ensure_level(level);
+
+    // append to the top level, then walk down: at each level above ours, swap to the front and shrink the level
+    order_.push_back(index);
+    queued_.set(index);
+    auto pos = static_cast<uint32_t>(order_.size() - 1);
+    position_[index] = pos;
+    for (auto l = static_cast<uint32_t>(level_start_.size() - 1); l > level; --l) {
+        swap(pos, level_start_[l]);
+        pos = level_start_[l]++;
+    }
+    shuffle_within_level(index);
+}
+
+void PiecePicker::increment(uint32_t index) {
+    const auto level = availability_[index]++;
+    ensure_level(level + 1);
+    if (position_[index] == NOT_QUEUED) return;
+
+    // move to the end of our level, then shift the boundary so we're at the start of the next one
+    swap(position_[index], level_end(level) - 1);
+    --level_start_[level + 1];
+    shuffle_within_level(index);
+}
+
+void PiecePicker::decrement(uint32_t index) {
+    if (availability_[index] == 0) return;
+    const auto level = availability_[index]--;
+    if (position_[index] == NOT_QUEUED) return;
+
+    // move to the start of our level, then shift the boundary so we're at the end of the previous one
+    swap(position_[index], level_start_[level]);
+    ++level_start_[level];
+    shuffle_within_level(index);
+}
+
+void PiecePicker::remove(uint32_t index) {
+    // bubble up to the very end: at each level, swap to the back and hand that slot to the next level
+    auto pos = position_[index];
+    for (auto l = availability_[index]; l < level_start_.size(); ++l) {
+        const auto last = level_end(l) - 1;
+        swap(pos, last);
+        pos = last;
+        if (l + 1 < level_start_.size()) --level_start_[l + 1];
+    }
+    assert(pos == order_.size() - 1);
+    order_.pop_back();
+    queued_.reset(index);
+    position_[index] = NOT_QUEUED;
+}
+
+void PiecePicker::shuffle_within_level(uint32_t index) {
+    const auto level = availability_[index];
+    const auto begin = level_start_[level];
+    const auto end = level_end(level);
+    if (end - begin < 2) return;
+    std::uniform_int_distribution<uint32_t> dist{begin, end - 1};
+    swap(position_[index], dist(rng_));
+}
@@ -0,0 +1,67 @@
+#include <piecetable.hpp>
+
+optional<BlockRef> PieceTable::reserve(const Bitfield& available, Peer* requester) {
+    // first try to help out with a piece that's already started
+    for (auto& [index, piece] : partial_) {
+        if (!available.get(index)) continue;
+        const auto block = piece.next_block(requester);
+        if (block) return BlockRef{index, block};
+    }
+
+    // otherwise start the rarest piece this peer has
+    const auto picked = picker_->pick(available);
+    if (picked) {
+        const auto index = *picked;
+        const auto offset = index * tor_.piece_size();
+        auto& piece = partial_.try_emplace(index, index, offset, tor_.piece_size(index)).first->second;
+        const auto block = piece.next_block(requester);
+        if (block) return BlockRef{index, block};
+    }
+
+    if (!endgame_ && all_requested()) {
+        endgame_ = true;
+    }
+    if (!endgame_) return std::nullopt;
+
+    // endgame: request blocks that are already outstanding with someone else
+    for (auto& [index, piece] : partial_) {
+        if (!available.get(index)) continue;
+        const auto block = piece.duplicate_block(requester, MAX_DUPLICATES);
+        if (block) return BlockRef{index, block};
+    }
+    return std::nullopt;
+}
+
+AcceptResult PieceTable::accept(const vector<char>& payload, const Address& from, const Peer* sender) {
+    if (payload.size() < 8) return AcceptResult{BlockStatus::WrongOffset, 0, 0, 0, {}};
+    const uint32_t index = ntohl(*reinterpret_cast<const uint32_t*>(payload.data()));
+    const uint32_t block = ntohl(*reinterpret_cast<const uint32_t*>(payload.data() + 4)) / BLOCK_SIZE;
+    const auto length = static_cast<uint32_t>(payload.size() - 8);
+
+    // if the piece isn't in the table, we already finished it (or never asked for it)
+    const auto it = partial_.find(index);
+    if (it == partial_.end()) return AcceptResult{BlockStatus::WrongPiece, index, block, length, {}};
+
+    const auto [status, _] = it->second.accept(payload, from);
+    AcceptResult result{status, index, block, length, {}};
+    if (status == BlockStatus::Ok && endgame_) {
+        for (const auto peer : it->second.block(block)->requesters()) {
+            if (peer != sender) result.duplicates.push_back(peer);
+        }
+    }
+    return result;
+}
+
+CompletePiece PieceTable::take_complete(uint32_t index) {
+    const auto it = partial_.find(index);
+    assert(it != partial_.end() && it->second.is_complete());
+    const auto result = it->second.finalize();
+    partial_.erase(it);
+    return result;
+}
+
+bool PieceTable::all_requested() const {
+    return picker_->remaining() == 0
+        && std::none_of(partial_.cbegin(), partial_.cend(),
+                        [](const auto& entry) { return entry.second.has_free_block(); });
+}
@@ -0,0 +1,66 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <connections.hpp>
+#include <result.hpp>
+#include <resume.hpp>
+#include <startup.hpp>
+#include <storage.hpp>
+
+using std::endl;
+
+static std::ostream& log() { return std::cout << "[resume] "; }
+
+// make the file its full size, returning how much of it existed before
+static off_t preallocate(const SingleFileTorrent& tor) {
+    const auto fd = ::open(tor.filename().c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 0;
+
+    struct stat st{};
+    const auto existing = ::fstat(fd, &st) == 0 ? st.st_size : 0;
+    // neither call touches data that's already there, so the monitor can be writing pieces meanwhile
+    if (existing > tor.file_length() || ::posix_fallocate(fd, 0, tor.file_length()) != 0) {
+        if (::ftruncate(fd, tor.file_length()) != 0) log() << "failed to preallocate " << tor.filename() << endl;
+    }
+    ::close(fd);
+    return existing;
+}
+
+void resume_thread(const TorrentContext& ctx) {
+    const auto& tor = ctx.tor;
+    const auto existing = preallocate(tor);
+
+    // only pieces that lie wholly within the old file can have been finished
+    Storage storage{tor.filename()};
+    vector<char> data;
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < tor.pieces(); ++i) {
+        const auto offset = static_cast<uint64_t>(i) * tor.piece_size();
+        const auto size = tor.piece_size(i);
+        if (offset + size > static_cast<uint64_t>(existing)) break;
+
+#ifdef SEEK_DATA
+        // pieces that are a hole in a sparse file were never written; skip straight to the next data
+        const auto next_data = ::lseek(storage.fd(), static_cast<off_t>(offset), SEEK_DATA);
+        if (next_data < 0) break;
+        if (static_cast<uint64_t>(next_data) >= offset + size) {
+            i = static_cast<uint32_t>(next_data / tor.piece_size()) - 1;
+            continue;
+        }
+#endif
+
+        data.resize(size);
+        if (!storage.read(offset, size, data.data())) break;
+        if (Hash::of(string{data.begin(), data.end()}) != tor.piece_hash(i)) continue;
+
+        ++found;
+        while (!ctx.result_queue->push(ResultPieceResumed{i}));
+        ba::post(ctx.io, [&ctx, i] { ctx.connections->piece_resumed(i); });
+    }
+
+    if (found > 0) log() << found << "/" << tor.pieces() << " pieces already on disk" << endl;
+    ctx.startup.reached(Startup::ResumeChecked);
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+
+#include <routingtable.hpp>
+
+size_t RoutingTable::size() const {
+    size_t count = 0;
+    for (const auto& bucket : buckets_) {
+        count += bucket.size();
+    }
+    return count;
+}
+
+size_t RoutingTable::bucket_of(const NodeId& id) const {
+    // the number of leading bits the id shares with ours
+    for (size_t i = 0; i < id.size(); ++i) {
+        const auto diff = static_cast<uint8_t>(id[i] ^ id_[i]);
+        if (diff != 0) return i * 8 + __builtin_clz(diff) - 24;
+    }
+    return BUCKETS - 1;
+}
+
+void RoutingTable::insert(const NodeId& id, const udp::endpoint& endpoint, bool verified) {
+    if (id == id_ || !endpoint.address().is_v4()) return;
+    auto& bucket = buckets_[bucket_of(id)];
+    const auto now = Clock::now();
+
+    const auto existing = std::find_if(bucket.begin(), bucket.end(), [&](const Node& node) { return node.id == id; });
+    if (existing != bucket.end()) {
+        if (verified) {
+            existing->endpoint = endpoint;
+            existing->last_seen = now;
+            existing->verified = true;
+            existing->failures = 0;
+        }
+        return;
+    }
+
+    if (bucket.size() < K) {
+        bucket.push_back(Node{id, endpoint, now, verified});
+        return;
+    }
+
+    // a full bucket only makes room by evicting a node that's failing, or one we've never heard from ourselves
+    auto victim = std::find_if(bucket.begin(), bucket.end(), [](const Node& node) { return node.failures > 0; });
+    if (victim == bucket.end() && verified) {
+        victim = std::find_if(bucket.begin(), bucket.end(), [](const Node& node) { return !node.verified; });
+    }
+    if (victim != bucket.end()) {
+        *victim = Node{id, endpoint, now, verified};
+    }
+}
+
+void RoutingTable::failed(const udp::endpoint& endpoint) {
+    for (auto& bucket : buckets_) {
+        for (auto node = bucket.begin(); node != bucket.end(); ++node) {
+            if (node->endpoint != endpoint) continue;
+            if (++node->failures >= MAX_FAILURES || !node->verified) {
+                bucket.erase(node);
+            }
+            return;
+        }
+    }
+}
+
+vector<RoutingTable::Node> RoutingTable::closest(const NodeId& target, size_t count) const {
+    vector<Node> nodes;
+    for (const auto& bucket : buckets_) {
+        nodes.insert(nodes.end(), bucket.begin(), bucket.end());
+    }
+    count = std::min(count, nodes.size());
+    std::partial_sort(nodes.begin(), nodes.begin() + count, nodes.end(),
+                      [&](const Node& lhs, const Node& rhs) { return closer(lhs.id, rhs.id, target); });
+    nodes.resize(count);
+    return nodes;
+}
+
+bool RoutingTable::closer(const NodeId& a, const NodeId& b, const NodeId& target) {
+    for (size_t i = 0; i < a.size(); ++i) {
+        const auto da = a[i] ^ target[i];
+        const auto db = b[i] ^ target[i];
+        if (da != db) return da < db;
+    }
+    return false;
+}
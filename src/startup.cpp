@@ -0,0 +1,28 @@
+#include <iostream>
+
+#include <startup.hpp>
+
+static const char* milestone_name(Startup::Milestone milestone) {
+    switch (milestone) {
+        case Startup::TorrentLoaded:
+            return "torrent loaded";
+        case Startup::TrackerReply:
+            return "first tracker reply";
+        case Startup::PeerConnected:
+            return "first peer connected";
+        case Startup::FirstBlock:
+            return "first block received";
+        case Startup::ResumeChecked:
+            return "resume check finished";
+        default:
+            return "?";
+    }
+}
+
+void Startup::reached(Milestone milestone) {
+    // cheap check first, since some milestones are reported on every block
+    if (reached_[milestone].load(std::memory_order_relaxed) || reached_[milestone].exchange(true)) return;
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    std::cout << "[startup] " << milestone_name(milestone) << " after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms" << std::endl;
+}
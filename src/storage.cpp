@@ -0,0 +1,31 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <storage.hpp>
+
+Storage::~Storage() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+int Storage::fd() {
+    if (fd_ < 0) fd_ = ::open(path_.c_str(), O_RDONLY);
+    return fd_;
+}
+
+void Storage::prefetch(uint64_t offset, uint32_t length) {
+#ifdef POSIX_FADV_WILLNEED
+    if (fd() >= 0) ::posix_fadvise(fd_, static_cast<off_t>(offset), length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+bool Storage::read(uint64_t offset, uint32_t length, char* out) {
+    if (fd() < 0) return false;
+    while (length > 0) {
+        const auto n = ::pread(fd_, out, length, static_cast<off_t>(offset));
+        if (n <= 0) return false;
+        out += n;
+        offset += n;
+        length -= n;
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#include <timerwheel.hpp>
+
+void TimerWheel::start() {
+    start_ = chrono::steady_clock::now();
+    schedule_tick();
+}
+
+void TimerWheel::arm(Timer& timer, chrono::milliseconds delay) {
+    timer.disarm();
+    // round up, and always wait for at least one tick
+    const auto ticks = std::max<uint64_t>(1, (delay + resolution_ - chrono::milliseconds{1}) / resolution_);
+    timer.expiry_ = now_ + ticks;
+    insert(timer);
+}
+
+void TimerWheel::schedule_tick() {
+    // schedule relative to the start, so that slow handlers don't make the wheel drift
+    tick_timer_.expires_at(start_ + resolution_ * (now_ + 1));
+    tick_timer_.async_wait([this](auto ec) {
+        if (ec.failed()) return;
+
+        // catch up on any ticks we missed
+        const auto elapsed = chrono::steady_clock::now() - start_;
+        const auto target = static_cast<uint64_t>(elapsed / resolution_);
+        while (now_ < target) {
+            tick();
+        }
+        schedule_tick();
+    });
+}
+
+void TimerWheel::tick() {
+    ++now_;
+
+    // when a level wraps around, pull the next slot of the level above down into it
+    for (size_t level = 1; level < LEVELS; ++level) {
+        if (cascade(level) != 0) break;
+    }
+
+    // detach the expired slot first, so callbacks can safely arm and disarm timers
+    Link expired;
+    expired.splice(slots_[0][now_ & SLOT_MASK]);
+    while (expired.linked()) {
+        auto& timer = static_cast<Timer&>(*expired.next);
+        timer.unlink();
+        timer.callback_();
+    }
+}
+
+void TimerWheel::insert(Timer& timer) {
+    const auto delta = timer.expiry_ - now_;
+    for (size_t level = 0; level < LEVELS; ++level) {
+        if (delta < (uint64_t{1} << (SLOT_BITS * (level + 1))) || level == LEVELS - 1) {
+            // deadlines beyond the top level are clamped to its range
+            const auto expiry = std::min(timer.expiry_, now_ + (uint64_t{1} << (SLOT_BITS * (level + 1))) - 1);
+            slots_[level][(expiry >> (SLOT_BITS * level)) & SLOT_MASK].push_back(&timer);
+            return;
+        }
+    }
+}
+
+uint64_t TimerWheel::cascade(size_t level) {
+    // only cascade when every level below has just wrapped around
+    if ((now_ & ((uint64_t{1} << (SLOT_BITS * level)) - 1)) != 0) return 1;
+
+    const auto index = (now_ >> (SLOT_BITS * level)) & SLOT_MASK;
+    Link pending;
+    pending.splice(slots_[level][index]);
+    while (pending.linked()) {
+        auto& timer = static_cast<Timer&>(*pending.next);
+        timer.unlink();
+        insert(timer);
+    }
+    return index;
+}
@@ -11,12 +11,37 @@ using std::string_view;
 SingleFileTorrent::SingleFileTorrent(const string_view &data) {
     const auto dict = std::get<bencode::dict_view>(bencode::decode_view(data));
     // torrents are *supposed* to have announce strings. in practice, they might not.
-    announce_ = std::get<bencode::string_view>(dict.at("announce"));
+    const auto announce = dict.find("announce");
+    if (announce != dict.end()) {
+        announce_ = std::get<bencode::string_view>(announce->second);
+    }
+
+    // announce-list (BEP 12) supersedes announce: a list of tiers, each a list of tracker URLs
+    const auto announce_list = dict.find("announce-list");
+    if (announce_list != dict.end()) {
+        for (const auto& tier : std::get<bencode::list_view>(announce_list->second)) {
+            vector<string> urls;
+            for (const auto& url : std::get<bencode::list_view>(tier)) {
+                urls.emplace_back(std::get<bencode::string_view>(url));
+            }
+            if (!urls.empty()) trackers_.push_back(std::move(urls));
+        }
+    }
+    if (trackers_.empty() && !announce_.empty()) {
+        trackers_.push_back({announce_});
+    }
 
-    // ensure it's HTTP
-    const auto start_pos = announce_.find("udp");
-    if (start_pos != std::string::npos) {
-        announce_.replace(start_pos, 3, "http");
+    // url-list is either one URL or a list of them
+    const auto url_list = dict.find("url-list");
+    if (url_list != dict.end()) {
+        if (const auto url = std::get_if<bencode::string_view>(&url_list->second.base())) {
+            if (!url->empty()) web_seeds_.emplace_back(*url);
+        } else {
+            for (const auto& entry : std::get<bencode::list_view>(url_list->second)) {
+                const auto url = std::get<bencode::string_view>(entry);
+                if (!url.empty()) web_seeds_.emplace_back(url);
+            }
+        }
     }
 
     // extract info
@@ -0,0 +1,545 @@
+#include <iostream>
+
+#include <bencode.hpp>
+
+#include <connections.hpp>
+#include <piecetable.hpp>
+#include <startup.hpp>
+#include <tracker.hpp>
+#include <upload.hpp>
+
+using std::endl;
+
+Tracker::Tracker(string url): url_(std::move(url)) {
+    const Url parts{url_};
+    host_ = parts.host;
+    service_ = parts.service;
+    path_ = parts.path;
+}
+
+shared_ptr<Tracker> Tracker::create(const TorrentContext& ctx, const string& url) {
+    if (url.compare(0, 7, "http://") == 0) return std::make_shared<HttpTracker>(ctx, url);
+    if (url.compare(0, 6, "udp://") == 0) return std::make_shared<UdpTracker>(ctx, url);
+    return nullptr;
+}
+
+HttpTracker::HttpTracker(const TorrentContext& ctx, string url)
+    : Tracker(std::move(url)), ctx_(ctx), resolver_(ctx.io), socket_(ctx.io), read_buffer_(4096) {}
+
+string HttpTracker::target(const AnnounceParams& params) const {
+    string target = path_;
+    target += path_.find('?') == string::npos ? '?' : '&';
+    target += "info_hash=";
+    target += cmn::urlencode(ctx_.tor.info_hash().as_bytes());
+    target += "&peer_id=";
+    target += cmn::urlencode(params.peer_id);
+    target += "&port=";
+    target += std::to_string(params.port);
+    target += "&uploaded=";
+    target += std::to_string(params.uploaded);
+    target += "&downloaded=";
+    target += std::to_string(params.downloaded);
+    target += "&left=";
+    target += std::to_string(params.left);
+    target += "&numwant=";
+    target += std::to_string(params.numwant);
+    target += "&compact=1";
+    switch (params.event) {
+        case AnnounceParams::Completed: target += "&event=completed"; break;
+        case AnnounceParams::Started: target += "&event=started"; break;
+        case AnnounceParams::Stopped: target += "&event=stopped"; break;
+        case AnnounceParams::None: break;
+    }
+    return target;
+}
+
+void HttpTracker::announce(const AnnounceParams& params, Handler handler) {
+    assert(!busy());
+    handler_ = std::move(handler);
+    const auto attempt = ++attempt_;
+    parser_.reset();
+
+    request_ = "GET ";
+    request_ += target(params);
+    request_ += " HTTP/1.1\r\nHost: ";
+    request_ += host_;
+    request_ += "\r\nConnection: close\r\nAccept-Encoding: identity\r\n\r\n";
+
+    ctx_.timers->arm(timeout_, TIMEOUT);
+    resolver_.async_resolve(host_, service_, [this, self = shared_from_this(), attempt](auto ec, auto endpoints) {
+        if (stale(attempt)) return;
+        if (ec) {
+            fail("can't resolve: " + ec.message());
+            return;
+        }
+        ba::async_connect(socket_, endpoints, [this, self, attempt](auto ec, auto) {
+            if (stale(attempt)) return;
+            if (ec) {
+                fail("can't connect: " + ec.message());
+                return;
+            }
+            ba::async_write(socket_, ba::buffer(request_), [this, self, attempt](auto ec, auto) {
+                if (stale(attempt)) return;
+                if (ec) {
+                    fail("error sending request: " + ec.message());
+                } else {
+                    async_read(attempt);
+                }
+            });
+        });
+    });
+}
+
+void HttpTracker::async_read(uint32_t attempt) {
+    socket_.async_read_some(ba::buffer(read_buffer_), [this, self = shared_from_this(), attempt](auto ec, auto length) {
+        if (stale(attempt)) return;
+        if (ec == ba::error::eof) {
+            parser_.feed_eof();
+        } else if (ec) {
+            fail("error reading response: " + ec.message());
+            return;
+        } else if (!parser_.feed(read_buffer_.data(), length)) {
+            fail("malformed response");
+            return;
+        }
+
+        if (parser_.done()) {
+            on_response();
+        } else if (ec) {
+            fail("connection closed early");
+        } else {
+            async_read(attempt);
+        }
+    });
+}
+
+void HttpTracker::on_response() {
+    if (parser_.status() != 200) {
+        fail("HTTP status " + std::to_string(parser_.status()));
+        return;
+    }
+
+    try {
+        // trackers report errors in a 200 response
+        const auto dict = std::get<bencode::dict_view>(bencode::decode_view(parser_.body()));
+        const auto failure = dict.find("failure reason");
+        if (failure != dict.end()) {
+            fail(string{std::get<bencode::string_view>(failure->second)});
+            return;
+        }
+        finish(TrackerResponse{parser_.body()});
+    } catch (const std::exception& e) {
+        fail(string{"invalid response: "} + e.what());
+    }
+}
+
+void HttpTracker::fail(const string& reason) {
+    if (!handler_) return;
+    log() << "announce failed: " << reason << endl;
+    finish(std::nullopt);
+}
+
+void HttpTracker::finish(optional<TrackerResponse> response) {
+    if (!handler_) return;
+    timeout_.disarm();
+    resolver_.cancel();
+    bs::error_code ec;
+    socket_.close(ec);
+
+    // the handler may announce again
+    auto handler = std::move(handler_);
+    handler_ = nullptr;
+    handler(std::move(response));
+}
+
+// UDP tracker packets are big-endian
+static void put_u16(vector<char>* packet, uint16_t value) {
+    packet->push_back(static_cast<char>(value >> 8));
+    packet->push_back(static_cast<char>(value));
+}
+
+static void put_u32(vector<char>* packet, uint32_t value) {
+    put_u16(packet, static_cast<uint16_t>(value >> 16));
+    put_u16(packet, static_cast<uint16_t>(value));
+}
+
+static void put_u64(vector<char>* packet, uint64_t value) {
+    put_u32(packet, static_cast<uint32_t>(value >> 32));
+    put_u32(packet, static_cast<uint32_t>(value));
+}
+
+static uint32_t get_u32(const char* data) {
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+    return (uint32_t{bytes[0]} << 24) | (uint32_t{bytes[1]} << 16) | (uint32_t{bytes[2]} << 8) | bytes[3];
+}
+
+static uint64_t get_u64(const char* data) {
+    return (uint64_t{get_u32(data)} << 32) | get_u32(data + 4);
+}
+
+UdpTracker::UdpTracker(const TorrentContext& ctx, string url)
+    : Tracker(std::move(url)), ctx_(ctx), resolver_(ctx.io), socket_(ctx.io), recv_buffer_(8192) {}
+
+void UdpTracker::announce(const AnnounceParams& params, Handler handler) {
+    assert(!busy());
+    params_ = params;
+    handler_ = std::move(handler);
+    begin(Announce);
+}
+
+void UdpTracker::scrape(vector<Hash> hashes, ScrapeHandler handler) {
+    assert(!busy());
+    scrape_hashes_ = std::move(hashes);
+    scrape_results_.clear();
+    scrape_handler_ = std::move(handler);
+    begin(Scrape);
+}
+
+void UdpTracker::begin(Action action) {
+    action_ = action;
+    attempt_ = 0;
+    if (endpoint_) {
+        send_request();
+        return;
+    }
+
+    resolver_.async_resolve(host_, service_, [this, self = shared_from_this()](auto ec, auto endpoints) {
+        if (!busy()) return;
+        // compact peer lists are IPv4 only, so prefer an IPv4 tracker address
+        for (const auto& entry : endpoints) {
+            if (!endpoint_ || (entry.endpoint().address().is_v4() && !endpoint_->address().is_v4())) {
+                endpoint_ = entry.endpoint();
+            }
+        }
+        if (ec || !endpoint_) {
+            fail("can't resolve: " + (ec ? ec.message() : "no addresses"));
+            return;
+        }
+
+        bs::error_code open_ec;
+        socket_.open(endpoint_->protocol(), open_ec);
+        if (open_ec) {
+            endpoint_.reset();
+            fail("can't open socket: " + open_ec.message());
+            return;
+        }
+        send_request();
+    });
+}
+
+void UdpTracker::send_request() {
+    transaction_ = rng_();
+    packet_.clear();
+
+    if (!connection_id_ || chrono::steady_clock::now() - connected_at_ >= CONNECTION_ID_LIFETIME) {
+        connection_id_.reset();
+        put_u64(&packet_, PROTOCOL_ID);
+        put_u32(&packet_, Connect);
+        put_u32(&packet_, transaction_);
+        transmit();
+        return;
+    }
+
+    put_u64(&packet_, *connection_id_);
+    put_u32(&packet_, action_);
+    put_u32(&packet_, transaction_);
+    if (action_ == Announce) {
+        const auto& hash = ctx_.tor.info_hash().as_bytes();
+        packet_.insert(packet_.end(), hash.begin(), hash.end());
+        packet_.insert(packet_.end(), params_.peer_id.begin(), params_.peer_id.end());
+        put_u64(&packet_, params_.downloaded);
+        put_u64(&packet_, params_.left);
+        put_u64(&packet_, params_.uploaded);
+        put_u32(&packet_, params_.event);
+        // IP address: the one the packet came from
+        put_u32(&packet_, 0);
+        put_u32(&packet_, key_);
+        put_u32(&packet_, params_.numwant);
+        put_u16(&packet_, params_.port);
+    } else {
+        // the next batch of hashes we don't have results for yet
+        const auto first = scrape_results_.size();
+        const auto last = std::min(scrape_hashes_.size(), first + MAX_SCRAPE);
+        for (auto i = first; i < last; ++i) {
+            const auto& hash = scrape_hashes_[i].as_bytes();
+            packet_.insert(packet_.end(), hash.begin(), hash.end());
+        }
+    }
+    transmit();
+}
+
+void UdpTracker::transmit() {
+    ctx_.timers->arm(retransmit_timer_, RETRANSMIT_TIMEOUT * (1 << attempt_));
+    socket_.async_send_to(ba::buffer(packet_), *endpoint_, [this, self = shared_from_this()](auto ec, auto) {
+        if (ec && ec != ba::error::operation_aborted && busy()) log() << "error sending: " << ec.message() << endl;
+    });
+    if (!receiving_) async_receive();
+}
+
+void UdpTracker::async_receive() {
+    receiving_ = true;
+    socket_.async_receive_from(ba::buffer(recv_buffer_), sender_,
+                               [this, self = shared_from_this()](auto ec, auto length) {
+        if (ec == ba::error::operation_aborted) return;
+        receiving_ = false;
+        if (!busy()) return;
+        if (!ec && sender_ == *endpoint_) on_receive(length);
+        // the exchange may be over now
+        if (busy() && !receiving_) async_receive();
+    });
+}
+
+void UdpTracker::on_receive(size_t length) {
+    // replies to anything but our current request are ignored
+    if (length < 8 || get_u32(recv_buffer_.data() + 4) != transaction_) return;
+    const auto data = recv_buffer_.data();
+    const auto action = get_u32(data);
+
+    if (action == Error) {
+        connection_id_.reset();
+        fail("tracker error: " + string{data + 8, data + length});
+    } else if (action == Connect && length >= 16) {
+        connection_id_ = get_u64(data + 8);
+        connected_at_ = chrono::steady_clock::now();
+        attempt_ = 0;
+        send_request();
+    } else if (action == Announce && action_ == Announce && length >= 20) {
+        // interval, leechers, seeders, then compact peers
+        const auto interval = get_u32(data + 8);
+        vector<Address> peers;
+        for (size_t offset = 20; offset + 6 <= length; offset += 6) {
+            peers.emplace_back(data + offset);
+        }
+        auto handler = std::move(handler_);
+        finish();
+        handler(TrackerResponse{interval, std::move(peers)});
+    } else if (action == Scrape && action_ == Scrape) {
+        const auto expected = std::min(scrape_hashes_.size() - scrape_results_.size(), MAX_SCRAPE);
+        if (length < 8 + 12 * expected) return;
+        for (size_t i = 0; i < expected; ++i) {
+            const auto entry = data + 8 + 12 * i;
+            scrape_results_.push_back(ScrapeInfo{get_u32(entry), get_u32(entry + 4), get_u32(entry + 8)});
+        }
+        if (scrape_results_.size() < scrape_hashes_.size()) {
+            attempt_ = 0;
+            send_request();
+            return;
+        }
+        auto handler = std::move(scrape_handler_);
+        finish();
+        handler(std::move(scrape_results_));
+    }
+}
+
+void UdpTracker::on_timeout() {
+    if (++attempt_ >= MAX_ATTEMPTS) {
+        fail("no response");
+        return;
+    }
+    // the connection ID may have expired while we were waiting
+    send_request();
+}
+
+void UdpTracker::fail(const string& reason) {
+    if (!busy()) return;
+    log() << (action_ == Scrape ? "scrape" : "announce") << " failed: " << reason << endl;
+    auto handler = std::move(handler_);
+    auto scrape_handler = std::move(scrape_handler_);
+    finish();
+    if (handler) handler(std::nullopt);
+    if (scrape_handler) scrape_handler(std::nullopt);
+}
+
+void UdpTracker::finish() {
+    handler_ = nullptr;
+    scrape_handler_ = nullptr;
+    retransmit_timer_.disarm();
+    // stop waiting for replies, so we don't keep ourselves alive
+    if (receiving_) {
+        bs::error_code ec;
+        socket_.cancel(ec);
+        receiving_ = false;
+    }
+}
+
+Announcer::Announcer(const TorrentContext& ctx, string peer_id, uint16_t port)
+    : ctx_(ctx), params_{std::move(peer_id), port} {
+    for (const auto& urls : ctx.tor.trackers()) {
+        vector<Entry> tier;
+        for (const auto& url : urls) {
+            if (auto tracker = Tracker::create(ctx, url)) {
+                tier.emplace_back().tracker = std::move(tracker);
+            } else {
+                std::cout << "[announcer] unsupported tracker: " << url << endl;
+            }
+        }
+        // trackers within a tier are tried in random order to share the load (BEP 12)
+        std::shuffle(tier.begin(), tier.end(), std::mt19937{std::random_device{}()});
+        if (!tier.empty()) tiers_.push_back(std::move(tier));
+    }
+}
+
+void Announcer::start() {
+    announce();
+    ctx_.timers->arm(check_timer_, CHECK_INTERVAL);
+}
+
+void Announcer::stop(std::function<void()> done) {
+    stopping_ = true;
+    on_stopped_ = std::move(done);
+    announce_timer_.disarm();
+    check_timer_.disarm();
+    update_params();
+    params_.numwant = 0;
+
+    // trackers still busy with an earlier announce are left to time us out
+    auto params = params_;
+    params.event = AnnounceParams::Stopped;
+    for (auto& tier : tiers_) {
+        for (auto& entry : tier) {
+            if (!entry.started || entry.tracker->busy()) continue;
+            ++pending_stops_;
+            entry.tracker->announce(params, [this](auto) {
+                if (--pending_stops_ == 0) stopped();
+            });
+        }
+    }
+    if (pending_stops_ == 0) {
+        stopped();
+    } else {
+        ctx_.timers->arm(stop_timer_, STOP_TIMEOUT);
+    }
+}
+
+void Announcer::stopped() {
+    stop_timer_.disarm();
+    if (!on_stopped_) return;
+    auto done = std::move(on_stopped_);
+    on_stopped_ = nullptr;
+    done();
+}
+
+void Announcer::update_params() {
+    params_.uploaded = ctx_.uploads->uploaded();
+    params_.downloaded = ctx_.connections->downloaded();
+    params_.left = ctx_.pieces->left();
+    // ask for as many peers as we have room for
+    params_.numwant = ctx_.connections->spare();
+}
+
+AnnounceParams::Event Announcer::event_for(const Entry& entry) const {
+    if (!entry.started) return AnnounceParams::Started;
+    // only if we did the downloading; a file that was already complete when we started doesn't count
+    if (params_.left == 0 && params_.downloaded > 0 && !entry.completed) return AnnounceParams::Completed;
+    return AnnounceParams::None;
+}
+
+void Announcer::announce() {
+    last_announce_ = Clock::now();
+    ctx_.timers->arm(announce_timer_, DEFAULT_INTERVAL);
+    update_params();
+
+    const auto first = round_++ == 0;
+    for (size_t tier = 0; tier < tiers_.size(); ++tier) {
+        if (first) {
+            for (auto& entry : tiers_[tier]) {
+                announce_to(tier, entry);
+            }
+        } else {
+            announce_next(tier);
+        }
+    }
+}
+
+void Announcer::check_peers() {
+    ctx_.timers->arm(check_timer_, CHECK_INTERVAL);
+    if (!finished_ && ctx_.pieces->left() == 0) {
+        finished_ = true;
+        if (ctx_.connections->downloaded() > 0) {
+            std::cout << "[announcer] download finished, announcing" << endl;
+            announce();
+            return;
+        }
+    }
+
+    const auto peers = ctx_.connections->connected() + ctx_.connections->half_open();
+    if (peers < ctx_.settings.min_peers && Clock::now() - last_announce_ >= ctx_.settings.min_announce_interval) {
+        std::cout << "[announcer] only " << peers << " peers, announcing early" << endl;
+        announce();
+    }
+}
+
+void Announcer::announce_next(size_t tier) {
+    for (auto& entry : tiers_[tier]) {
+        if (entry.round != round_) {
+            announce_to(tier, entry);
+            return;
+        }
+    }
+}
+
+void Announcer::announce_to(size_t tier, Entry& entry) {
+    entry.round = round_;
+    if (entry.tracker->busy()) return;
+    auto params = params_;
+    params.event = event_for(entry);
+
+    // a UDP scrape is one small round trip, and there's no point asking for more peers than the swarm has. the
+    // first announce and the ones carrying an event don't wait for it
+    const auto udp = std::dynamic_pointer_cast<UdpTracker>(entry.tracker);
+    if (udp && round_ > 1 && params.event == AnnounceParams::None) {
+        udp->scrape({ctx_.tor.info_hash()}, [this, tier, udp, params](auto info) mutable {
+            if (stopping_) return;
+            if (info && !info->empty()) {
+                const auto swarm = info->front().seeders + info->front().leechers;
+                params.numwant = std::min(params.numwant, swarm);
+            }
+            send_announce(tier, udp, params);
+        });
+        return;
+    }
+    send_announce(tier, entry.tracker, params);
+}
+
+void Announcer::send_announce(size_t tier, const shared_ptr<Tracker>& tracker, const AnnounceParams& params) {
+    const auto complete = params.left == 0;
+    tracker->announce(params, [this, tier, tracker = tracker.get(), sent = Clock::now(), complete]
+            (auto response) { on_response(tier, tracker, sent, complete, response); });
+}
+
+void Announcer::on_response(size_t tier, const Tracker* tracker, Clock::time_point sent, bool complete,
+                            const optional<TrackerResponse>& response) {
+    if (stopping_) return;
+    auto& entries = tiers_[tier];
+    const auto entry = std::find_if(entries.begin(), entries.end(),
+                                    [&](const auto& entry) { return entry.tracker.get() == tracker; });
+    if (response) {
+        entry->latency = Clock::now() - sent;
+        entry->failures = 0;
+        // an announce made with nothing left covers the completed event, whichever event it carried
+        entry->started = true;
+        entry->completed = entry->completed || complete;
+        // the next announce is due when the tracker asks for it
+        const auto interval = std::max<chrono::milliseconds>(chrono::seconds{response->interval()},
+                                                             ctx_.settings.min_announce_interval);
+        ctx_.timers->arm(announce_timer_, interval);
+        ctx_.startup.reached(Startup::TrackerReply);
+        // the connection manager ignores peers it already knows about, from this tracker or any other
+        ctx_.connections->add_candidates(response->peers());
+        std::cout << "[announcer] " << response->peers().size() << " peers from " << tracker->url() << " in "
+                  << chrono::duration_cast<chrono::milliseconds>(*entry->latency).count() << "ms" << endl;
+    } else {
+        entry->latency.reset();
+        ++entry->failures;
+    }
+
+    // trackers that answer go first, fastest first; ones that don't sink to the back
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        if (lhs.latency && rhs.latency) return *lhs.latency < *rhs.latency;
+        if (lhs.latency || rhs.latency) return static_cast<bool>(lhs.latency);
+        return lhs.failures < rhs.failures;
+    });
+
+    // after the first round, a tier only moves on to its next tracker when one fails
+    if (!response && round_ > 1) announce_next(tier);
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include <connections.hpp>
+#include <peer.hpp>
+#include <piecetable.hpp>
+#include <upload.hpp>
+
+#ifdef __linux__
+static constexpr bool HAVE_SENDFILE = true;
+#else
+static constexpr bool HAVE_SENDFILE = false;
+#endif
+
+Uploader::Uploader(const TorrentContext& ctx, const Settings& settings)
+    : ctx_(ctx), settings_(settings), zero_copy_(HAVE_SENDFILE && settings.zero_copy_uploads),
+      storage_(ctx.tor.filename()), cache_(ctx.tor, storage_, settings.read_cache_size) {}
+
+void Uploader::ready(const shared_ptr<Peer>& peer) {
+    ready_.push_back(peer);
+    // wait for the rest of this turn of the io loop, so requests that arrive together are served round-robin
+    if (!pump_scheduled_) {
+        pump_scheduled_ = true;
+        ba::post(ctx_.io, [this] { pump(); });
+    }
+}
+
+void Uploader::start() {
+    ctx_.timers->arm(choke_timer_, settings_.rechoke_interval);
+}
+
+uint32_t Uploader::slots() const {
+    if (settings_.upload_capacity == 0) return settings_.upload_slots;
+    return std::max<uint64_t>(2, settings_.upload_capacity / settings_.upload_slot_rate);
+}
+
+bool Uploader::read_block(const UploadRequest& request, vector<char>* out) {
+    if (cache_.enabled()) return cache_.read(request.piece, request.offset, request.length, out);
+
+    const auto start = out->size();
+    out->resize(start + request.length);
+    if (!storage_.read(file_offset(request), request.length, out->data() + start)) {
+        out->resize(start);
+        return false;
+    }
+    return true;
+}
+
+bool Uploader::can_sendfile() {
+    return zero_copy_ && storage_.fd() >= 0;
+}
+
+void Uploader::pump() {
+    pump_scheduled_ = false;
+
+    // one block per peer per round; peers that still have requests and buffer space go to the back
+    for (uint32_t served = 0; served < BLOCKS_PER_PUMP && !ready_.empty(); ++served) {
+        const auto peer = ready_.front().lock();
+        ready_.pop_front();
+        if (peer && peer->serve_next()) {
+            ready_.push_back(peer);
+        }
+    }
+
+    if (!ready_.empty() && !pump_scheduled_) {
+        pump_scheduled_ = true;
+        ba::post(ctx_.io, [this] { pump(); });
+    }
+}
+
+void Uploader::rechoke() {
+    ctx_.timers->arm(choke_timer_, settings_.rechoke_interval);
+
+    // rank interested peers by how fast they send to us; once we're seeding, by how fast they take from us. LAN peers
+    // are so much faster than the rest that they come first regardless
+    const auto seeding = ctx_.pieces->have().count() == ctx_.tor.pieces();
+    struct Ranked {
+        bool local;
+        double rate;
+        shared_ptr<Peer> peer;
+    };
+    vector<Ranked> ranked;
+    for (const auto& [addr, peer] : ctx_.connections->peers()) {
+        if (peer->peer_interested()) {
+            ranked.push_back(Ranked{ctx_.connections->is_local(addr),
+                                    seeding ? peer->upload_rate() : peer->download_rate(), peer});
+        }
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.local != rhs.local ? lhs.local : lhs.rate > rhs.rate;
+    });
+    const auto top = std::min<size_t>(slots(), ranked.size());
+
+    // the optimistic unchoke moves on when its time is up, or if it's no longer a candidate for it
+    auto optimistic = optimistic_.lock();
+    const auto still_candidate = std::any_of(ranked.begin() + top, ranked.end(),
+                                             [&](const auto& entry) { return entry.peer == optimistic; });
+    const auto now = chrono::steady_clock::now();
+    if (!still_candidate || now - last_optimistic_ >= settings_.optimistic_interval) {
+        optimistic.reset();
+        if (ranked.size() > top) {
+            std::uniform_int_distribution<size_t> pick(top, ranked.size() - 1);
+            optimistic = ranked[pick(rng_)].peer;
+        }
+        optimistic_ = optimistic;
+        last_optimistic_ = now;
+    }
+
+    // choke first, so the slots are free for the peers we unchoke
+    const auto should_unchoke = [&](const shared_ptr<Peer>& peer) {
+        return peer == optimistic || std::any_of(ranked.begin(), ranked.begin() + top,
+                                                 [&](const auto& entry) { return entry.peer == peer; });
+    };
+    for (const auto& [_, peer] : ctx_.connections->peers()) {
+        if (!should_unchoke(peer)) peer->set_choking(true);
+    }
+    for (const auto& [_, peer] : ctx_.connections->peers()) {
+        if (should_unchoke(peer)) peer->set_choking(false);
+    }
+}
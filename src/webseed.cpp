@@ -0,0 +1,244 @@
+#include <iostream>
+
+#include <connections.hpp>
+#include <picker.hpp>
+#include <piecetable.hpp>
+#include <result.hpp>
+#include <startup.hpp>
+#include <webseed.hpp>
+
+using std::endl;
+
+// a URL ending in a slash names a directory holding the file (BEP 19)
+static string file_url(string url, const string& filename) {
+    if (!url.empty() && url.back() == '/') url += cmn::urlencode(filename);
+    return url;
+}
+
+WebSeed::WebSeed(const TorrentContext& ctx, string url)
+    : ctx_(ctx), url_(file_url(std::move(url), ctx.tor.filename())), parts_(url_), everything_(ctx.tor.pieces()),
+      resolver_(ctx.io), socket_(ctx.io), read_buffer_(64 * 1024),
+      parser_(std::min<uint64_t>(ctx.tor.file_length(), std::max<uint64_t>(MAX_RANGE, ctx.tor.piece_size()))) {
+    for (uint32_t i = 0; i < ctx.tor.pieces(); ++i) {
+        everything_.set(i);
+    }
+}
+
+std::unique_ptr<WebSeed> WebSeed::create(const TorrentContext& ctx, const string& url) {
+    if (url.compare(0, 7, "http://") == 0) return std::make_unique<WebSeed>(ctx, url);
+    return nullptr;
+}
+
+void WebSeed::start() {
+    next();
+}
+
+void WebSeed::next() {
+    if (ctx_.pieces->left() == 0) {
+        bs::error_code ec;
+        socket_.close(ec);
+        return;
+    }
+
+    // the rarest piece, and as many of the ones after it as nobody has started yet
+    const auto first = ctx_.picker->pick(everything_);
+    if (!first) {
+        ctx_.timers->arm(retry_timer_, IDLE_INTERVAL);
+        return;
+    }
+    first_ = *first;
+    count_ = 1;
+    const auto length = run_length();
+    while (count_ < length && first_ + count_ < ctx_.tor.pieces() && ctx_.picker->queued(first_ + count_)) {
+        ctx_.picker->discard(first_ + count_);
+        ++count_;
+    }
+
+    const uint64_t begin = static_cast<uint64_t>(first_) * ctx_.tor.piece_size();
+    const uint64_t end = begin + static_cast<uint64_t>(count_ - 1) * ctx_.tor.piece_size()
+                         + ctx_.tor.piece_size(first_ + count_ - 1);
+    request_ = "GET " + parts_.path + " HTTP/1.1\r\nHost: " + parts_.host
+               + "\r\nRange: bytes=" + std::to_string(begin) + "-" + std::to_string(end - 1)
+               + "\r\nConnection: keep-alive\r\nAccept-Encoding: identity\r\n\r\n";
+    parser_.reset();
+    requested_at_ = chrono::steady_clock::now();
+    ctx_.timers->arm(timeout_, TIMEOUT);
+
+    // the connection stays open between requests unless the server closes it
+    const auto attempt = ++attempt_;
+    reused_ = socket_.is_open();
+    received_ = 0;
+    if (reused_) {
+        async_request(attempt);
+    } else {
+        async_connect(attempt);
+    }
+}
+
+uint32_t WebSeed::run_length() const {
+    const double piece_size = ctx_.tor.piece_size();
+    const auto most = std::max<uint32_t>(1, static_cast<uint32_t>(MAX_RANGE / piece_size));
+    if (rate_ == 0) return 1;
+    const auto target = rate_ * chrono::duration<double>(RANGE_TARGET).count() / piece_size;
+    return std::clamp<uint32_t>(static_cast<uint32_t>(target), 1, most);
+}
+
+void WebSeed::async_connect(uint32_t attempt) {
+    resolver_.async_resolve(parts_.host, parts_.service, [this, attempt](auto ec, auto endpoints) {
+        if (attempt != attempt_) return;
+        if (ec) {
+            fail("can't resolve: " + ec.message());
+            return;
+        }
+        ba::async_connect(socket_, endpoints, [this, attempt](auto ec, auto) {
+            if (attempt != attempt_) return;
+            if (ec) {
+                fail("can't connect: " + ec.message());
+            } else {
+                async_request(attempt);
+            }
+        });
+    });
+}
+
+void WebSeed::async_request(uint32_t attempt) {
+    ba::async_write(socket_, ba::buffer(request_), [this, attempt](auto ec, auto) {
+        if (attempt != attempt_) return;
+        if (ec) {
+            fail("error sending request: " + ec.message());
+        } else {
+            async_read(attempt);
+        }
+    });
+}
+
+void WebSeed::async_read(uint32_t attempt) {
+    socket_.async_read_some(ba::buffer(read_buffer_), [this, attempt](auto ec, auto length) {
+        if (attempt != attempt_) return;
+        // the server may have closed the idle connection just as we reused it; that's worth one more try
+        if (ec && reused_ && received_ == 0) {
+            bs::error_code ignored;
+            socket_.close(ignored);
+            reused_ = false;
+            async_connect(attempt);
+            return;
+        }
+        received_ += length;
+
+        const auto parsed = ec || parser_.feed(read_buffer_.data(), length);
+        // a server that ignores Range sends the whole file, which we can only take if it fits in one response
+        if (parser_.headers_done() && parser_.status() == 200 && ctx_.tor.file_length() > MAX_RANGE) {
+            disable("server ignores Range requests and the file is too big to fetch whole");
+            return;
+        }
+        if (ec == ba::error::eof) {
+            parser_.feed_eof();
+        } else if (ec) {
+            fail("error reading response: " + ec.message());
+            return;
+        } else if (!parsed) {
+            fail("malformed response");
+            return;
+        }
+        ctx_.timers->arm(timeout_, TIMEOUT);
+
+        if (parser_.done()) {
+            if (ec || !parser_.keep_alive()) {
+                bs::error_code ignored;
+                socket_.close(ignored);
+            }
+            on_response();
+        } else if (ec) {
+            fail("connection closed early");
+        } else {
+            async_read(attempt);
+        }
+    });
+}
+
+void WebSeed::on_response() {
+    timeout_.disarm();
+    ++attempt_;
+
+    if (parser_.status() != 206 && parser_.status() != 200) {
+        fail("HTTP status " + std::to_string(parser_.status()));
+        return;
+    }
+
+    // a server that ignores Range sends the whole file
+    const auto& body = parser_.body();
+    const uint64_t skip = parser_.status() == 200 ? static_cast<uint64_t>(first_) * ctx_.tor.piece_size() : 0;
+    uint64_t length = 0;
+    for (uint32_t i = 0; i < count_; ++i) {
+        length += ctx_.tor.piece_size(first_ + i);
+    }
+    if (body.size() < skip + length) {
+        fail("response too short");
+        return;
+    }
+
+    // check each piece as if it came from a peer; the monitor writes it and tells the connection manager
+    const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - requested_at_).count();
+    uint64_t offset = skip;
+    bool corrupt = false;
+    for (uint32_t i = 0; i < count_; ++i) {
+        const auto index = first_ + i;
+        const auto size = ctx_.tor.piece_size(index);
+        auto piece = CompletePiece{new char[size], index, index * ctx_.tor.piece_size(), size};
+        std::copy(body.begin() + offset, body.begin() + offset + size, piece.data());
+        offset += size;
+
+        if (piece.hash() == ctx_.tor.piece_hash(index)) {
+            ctx_.startup.reached(Startup::FirstBlock);
+            while (!ctx_.result_queue->push(ResultPieceComplete{piece}));
+        } else {
+            log() << "piece " << index << ": failed hash check" << endl;
+            piece.free();
+            ctx_.pieces->requeue(index);
+            corrupt = true;
+        }
+    }
+    count_ = 0;
+
+    // a server with a bad copy gets the same backoff as one that's down
+    if (corrupt) {
+        back_off();
+        return;
+    }
+
+    failures_ = 0;
+    const auto sample = static_cast<double>(length) / std::max(seconds, 0.001);
+    rate_ = rate_ == 0 ? sample : 0.7 * rate_ + 0.3 * sample;
+    next();
+}
+
+void WebSeed::fail(const string& reason) {
+    log() << "request failed: " << reason << endl;
+    abort();
+    back_off();
+}
+
+void WebSeed::disable(const string& reason) {
+    log() << "giving up on this web seed: " << reason << endl;
+    abort();
+}
+
+void WebSeed::abort() {
+    timeout_.disarm();
+    ++attempt_;
+    resolver_.cancel();
+    bs::error_code ec;
+    socket_.close(ec);
+
+    // someone else can have the pieces while we wait
+    for (uint32_t i = 0; i < count_; ++i) {
+        ctx_.pieces->requeue(first_ + i);
+    }
+    count_ = 0;
+}
+
+void WebSeed::back_off() {
+    ++failures_;
+    const auto delay = RETRY_DELAY * (1u << std::min(failures_ - 1, 16u));
+    ctx_.timers->arm(retry_timer_, std::min<chrono::milliseconds>(MAX_RETRY_DELAY, delay));
+}
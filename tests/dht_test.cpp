@@ -0,0 +1,165 @@
+#include <filesystem>
+
+#include <gtest/gtest.h>
+
+#include <connections.hpp>
+#include <dht.hpp>
+#include <routingtable.hpp>
+
+#include "support.hpp"
+
+using ba::ip::udp;
+typedef RoutingTable::NodeId NodeId;
+
+// an id that shares `shared` leading bits with `base`, then differs; `tag` fills the last byte to tell them apart
+static NodeId id_near(const NodeId& base, size_t shared, uint8_t tag) {
+    auto id = base;
+    id[shared / 8] ^= static_cast<uint8_t>(0x80 >> (shared % 8));
+    id[19] = static_cast<uint8_t>(id[19] ^ tag);
+    return id;
+}
+
+static udp::endpoint endpoint_of(uint16_t port) {
+    return {ba::ip::address_v4::loopback(), port};
+}
+
+// a port nothing is listening on right now
+static uint16_t free_port(ba::io_context& io) {
+    udp::socket socket{io, udp::endpoint{ba::ip::address_v4::loopback(), 0}};
+    return socket.local_endpoint().port();
+}
+
+TEST(RoutingTableTest, BucketsByCommonPrefix) {
+    const NodeId own{};
+    RoutingTable table{own};
+    EXPECT_EQ(table.bucket_of(id_near(own, 0, 0)), 0u);
+    EXPECT_EQ(table.bucket_of(id_near(own, 9, 0)), 9u);
+    EXPECT_EQ(table.bucket_of(id_near(own, 159, 0)), 159u);
+
+    table.insert(id_near(own, 3, 0), endpoint_of(1000), false);
+    table.insert(id_near(own, 3, 0), endpoint_of(1001), false);
+    // our own id never goes in
+    table.insert(own, endpoint_of(1002), true);
+    EXPECT_EQ(table.size(), 1u);
+    EXPECT_EQ(table.bucket(3).size(), 1u);
+    // hearsay doesn't move a node we already know
+    EXPECT_EQ(table.bucket(3)[0].endpoint.port(), 1000);
+}
+
+TEST(RoutingTableTest, FullBucketEvictsOnlyWeakerNodes) {
+    const NodeId own{};
+    RoutingTable table{own};
+    for (uint8_t i = 0; i < RoutingTable::K; ++i) {
+        table.insert(id_near(own, 0, i), endpoint_of(1000 + i), true);
+    }
+    ASSERT_EQ(table.bucket(0).size(), RoutingTable::K);
+
+    // every node is good, so newcomers are turned away
+    table.insert(id_near(own, 0, 100), endpoint_of(2000), true);
+    EXPECT_EQ(table.size(), RoutingTable::K);
+
+    // a node that's failing makes way, even for one we've only heard about
+    table.failed(endpoint_of(1002));
+    EXPECT_EQ(table.size(), RoutingTable::K);
+    table.insert(id_near(own, 0, 101), endpoint_of(2001), false);
+    EXPECT_EQ(table.bucket(0)[2].endpoint.port(), 2001);
+
+    // and an unverified node makes way for one that answered us, but not for more hearsay
+    table.insert(id_near(own, 0, 102), endpoint_of(2002), false);
+    EXPECT_EQ(table.bucket(0)[2].endpoint.port(), 2001);
+    table.insert(id_near(own, 0, 103), endpoint_of(2003), true);
+    EXPECT_EQ(table.bucket(0)[2].endpoint.port(), 2003);
+}
+
+TEST(RoutingTableTest, DropsNodesThatKeepFailing) {
+    const NodeId own{};
+    RoutingTable table{own};
+    table.insert(id_near(own, 1, 0), endpoint_of(1000), true);
+    table.insert(id_near(own, 2, 0), endpoint_of(1001), false);
+
+    // unverified nodes go on their first failure, verified ones after MAX_FAILURES
+    table.failed(endpoint_of(1001));
+    EXPECT_EQ(table.size(), 1u);
+    for (uint32_t i = 1; i < RoutingTable::MAX_FAILURES; ++i) table.failed(endpoint_of(1000));
+    EXPECT_EQ(table.size(), 1u);
+    // answering clears the count
+    table.insert(id_near(own, 1, 0), endpoint_of(1000), true);
+    for (uint32_t i = 1; i < RoutingTable::MAX_FAILURES; ++i) table.failed(endpoint_of(1000));
+    EXPECT_EQ(table.size(), 1u);
+    table.failed(endpoint_of(1000));
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(RoutingTableTest, ClosestByXorDistance) {
+    const NodeId own{};
+    RoutingTable table{own};
+    for (size_t shared = 0; shared < 20; ++shared) {
+        table.insert(id_near(own, shared, 0), endpoint_of(static_cast<uint16_t>(1000 + shared)), true);
+    }
+
+    // nearest our own id means the longest common prefix
+    const auto nodes = table.closest(own, 3);
+    ASSERT_EQ(nodes.size(), 3u);
+    EXPECT_EQ(nodes[0].endpoint.port(), 1019);
+    EXPECT_EQ(nodes[1].endpoint.port(), 1018);
+    EXPECT_EQ(nodes[2].endpoint.port(), 1017);
+
+    // a target in the far half of the space is nearest the node that differs in the first bit
+    EXPECT_EQ(table.closest(id_near(own, 0, 0), 1)[0].endpoint.port(), 1000);
+    EXPECT_EQ(table.closest(own, 100).size(), 20u);
+}
+
+// a swarm of DHT nodes on loopback, all bootstrapped from the first. they look up and announce the torrent among
+// themselves; nobody dials the peers they find
+class DhtTest: public ::testing::Test {
+protected:
+    static constexpr size_t SWARM = 8;
+
+    DhtTest(): test(make_torrent("dht.bin", string(1024, 'x'), 1024)) {
+        test.settings.max_connections = 0;
+        test.ctx.connections = std::make_shared<ConnectionManager>(test.ctx, test.settings);
+        dir = std::filesystem::temp_directory_path() / ("picotor-dht-" + std::to_string(::getpid()));
+        std::filesystem::create_directories(dir);
+    }
+
+    ~DhtTest() override {
+        nodes.clear();
+        std::filesystem::remove_all(dir);
+    }
+
+    Dht& add_node(const TorrentContext& ctx, const vector<std::pair<string, string>>& routers) {
+        const auto port = free_port(test.io);
+        ports.push_back(port);
+        auto path = (dir / ("node" + std::to_string(nodes.size()))).string();
+        nodes.push_back(std::make_unique<Dht>(ctx, port, std::move(path)));
+        nodes.back()->start(routers);
+        return *nodes.back();
+    }
+
+    TestContext test;
+    std::filesystem::path dir;
+    vector<uint16_t> ports;
+    vector<std::unique_ptr<Dht>> nodes;
+};
+
+TEST_F(DhtTest, LookupFindsAnnouncedPeers) {
+    add_node(test.ctx, {});
+    const vector<std::pair<string, string>> router{{"127.0.0.1", std::to_string(ports[0])}};
+    for (size_t i = 1; i < SWARM; ++i) {
+        add_node(test.ctx, router);
+    }
+    // every node has found the router, and the router has heard from all of them
+    ASSERT_TRUE(test.run_until([&] {
+        return std::all_of(nodes.begin(), nodes.end(), [](const auto& node) { return node->nodes() > 0; })
+               && nodes[0]->nodes() == SWARM - 1;
+    }));
+    // let the swarm's lookups finish and announce
+    test.run_until([] { return false; }, 500ms);
+
+    // a newcomer that only knows the router walks the swarm and finds the others' DHT ports as peers
+    auto ctx = test.ctx;
+    ctx.connections = std::make_shared<ConnectionManager>(ctx, test.settings);
+    const auto& searcher = add_node(ctx, router);
+    ASSERT_TRUE(test.run_until([&] { return ctx.connections->known() > 0 && searcher.nodes() > 1; }));
+    EXPECT_GT(searcher.nodes(), 1u);
+}
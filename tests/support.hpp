@@ -0,0 +1,85 @@
+#ifndef PICOTOR_TESTS_SUPPORT_HPP
+#define PICOTOR_TESTS_SUPPORT_HPP
+
+#include <boost/asio.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include <bencode.hpp>
+#include <picker.hpp>
+#include <piecetable.hpp>
+#include <settings.hpp>
+#include <startup.hpp>
+#include <timerwheel.hpp>
+#include <torrent.hpp>
+
+// a single-file torrent of `data`, bencoded the way SingleFileTorrent expects
+inline string make_torrent(const string& name, const string& data, uint32_t piece_length,
+                           const vector<string>& web_seeds = {}) {
+    string hashes;
+    for (size_t offset = 0; offset < data.size(); offset += piece_length) {
+        const auto hash = Hash::of(data.substr(offset, piece_length)).as_bytes();
+        hashes.append(hash.begin(), hash.end());
+    }
+    bencode::dict info;
+    info["name"] = name;
+    info["length"] = bencode::integer{static_cast<int64_t>(data.size())};
+    info["piece length"] = bencode::integer{piece_length};
+    info["pieces"] = hashes;
+
+    bencode::dict torrent;
+    torrent["info"] = std::move(info);
+    if (!web_seeds.empty()) {
+        bencode::list urls;
+        for (const auto& url : web_seeds) urls.emplace_back(url);
+        torrent["url-list"] = std::move(urls);
+    }
+    return bencode::encode(torrent);
+}
+
+// everything a component needs from its context, for a torrent we have none of. there's no connection manager,
+// uploader or monitor; results pile up in the queue for the test to look at
+struct TestContext {
+    explicit TestContext(const string& torrent)
+        : tor(torrent),
+          result_queue(std::make_shared<boost::lockfree::queue<Result>>(tor.pieces())),
+          picker(std::make_shared<PiecePicker>(tor.pieces())),
+          pieces(std::make_shared<PieceTable>(tor, picker)),
+          timers(std::make_shared<TimerWheel>(io, 10ms)),
+          ctx{io, settings, handshake, tor, result_queue, picker, pieces, timers, nullptr, nullptr, startup} {}
+
+    // run the io loop until `done` says so, or the time is up; false if it timed out
+    template <typename Predicate>
+    bool run_until(Predicate done, chrono::milliseconds limit = 10s) {
+        const auto deadline = chrono::steady_clock::now() + limit;
+        io.restart();
+        while (!done()) {
+            if (chrono::steady_clock::now() >= deadline) return false;
+            io.run_one_for(10ms);
+        }
+        return true;
+    }
+
+    ba::io_context io;
+    Settings settings;
+    vector<char> handshake;
+    Startup startup;
+    SingleFileTorrent tor;
+    shared_ptr<boost::lockfree::queue<Result>> result_queue;
+    shared_ptr<PiecePicker> picker;
+    shared_ptr<PieceTable> pieces;
+    shared_ptr<TimerWheel> timers;
+    TorrentContext ctx;
+};
+
+// big-endian fields, as UDP tracker and DHT packets use them
+inline void put_be(string* out, uint64_t value, size_t bytes) {
+    for (size_t i = bytes; i-- > 0;) out->push_back(static_cast<char>(value >> (8 * i)));
+}
+
+inline uint64_t get_be(const char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value = (value << 8) | static_cast<uint8_t>(data[i]);
+    return value;
+}
+
+#endif //PICOTOR_TESTS_SUPPORT_HPP
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <tracker.hpp>
+
+#include "support.hpp"
+
+using ba::ip::udp;
+
+// a stand-in BEP 15 tracker on loopback. every announce gets the same two peers back; a scrape of hash i reports
+// i seeders, 2i completed and i + 1 leechers
+class StandInTracker {
+public:
+    explicit StandInTracker(ba::io_context& io): socket_(io, udp::endpoint{ba::ip::address_v4::loopback(), 0}) {
+        receive();
+    }
+
+    [[nodiscard]] string url() const { return "udp://127.0.0.1:" + std::to_string(socket_.local_endpoint().port()); }
+
+    // hashes the scrape packets will be asked about, in the order the counts are reported for
+    vector<Hash> hashes;
+
+    uint32_t connects = 0;
+    uint32_t announces = 0;
+    vector<size_t> scrape_sizes;
+    uint32_t last_event = 0;
+    uint32_t last_numwant = 0;
+
+private:
+    static constexpr uint64_t CONNECTION_ID = 0x1122334455667788;
+
+    udp::socket socket_;
+    udp::endpoint sender_;
+    char buffer_[2048];
+
+    void receive() {
+        socket_.async_receive_from(ba::buffer(buffer_), sender_, [this](auto ec, auto length) {
+            if (ec) return;
+            reply(length);
+            receive();
+        });
+    }
+
+    void reply(size_t length) {
+        if (length < 16) return;
+        const auto action = static_cast<uint32_t>(get_be(buffer_ + 8, 4));
+        const auto transaction = get_be(buffer_ + 12, 4);
+        string out;
+        put_be(&out, action, 4);
+        put_be(&out, transaction, 4);
+
+        if (action == 0) {
+            EXPECT_EQ(get_be(buffer_, 8), 0x41727101980u);
+            ++connects;
+            put_be(&out, CONNECTION_ID, 8);
+        } else if (get_be(buffer_, 8) != CONNECTION_ID) {
+            return;
+        } else if (action == 1 && length >= 98) {
+            ++announces;
+            last_event = static_cast<uint32_t>(get_be(buffer_ + 80, 4));
+            last_numwant = static_cast<uint32_t>(get_be(buffer_ + 92, 4));
+            put_be(&out, 1800, 4);
+            put_be(&out, 1, 4);
+            put_be(&out, 1, 4);
+            for (const uint32_t ip : {0x0a000001u, 0x0a000002u}) {
+                put_be(&out, ip, 4);
+                put_be(&out, 6881, 2);
+            }
+        } else if (action == 2) {
+            scrape_sizes.push_back((length - 16) / cmn::HASH_SIZE);
+            for (size_t offset = 16; offset + cmn::HASH_SIZE <= length; offset += cmn::HASH_SIZE) {
+                const Hash hash{buffer_ + offset};
+                const auto index = std::find(hashes.begin(), hashes.end(), hash) - hashes.begin();
+                put_be(&out, index, 4);
+                put_be(&out, 2 * index, 4);
+                put_be(&out, index + 1, 4);
+            }
+        } else {
+            return;
+        }
+        socket_.send_to(ba::buffer(out), sender_);
+    }
+};
+
+class UdpTrackerTest : public ::testing::Test {
+protected:
+    TestContext context{make_torrent("file", string(64 * 1024, 'x'), 16 * 1024)};
+    StandInTracker stand_in{context.io};
+    shared_ptr<UdpTracker> tracker = std::make_shared<UdpTracker>(context.ctx, stand_in.url());
+};
+
+TEST_F(UdpTrackerTest, AnnounceReusesConnectionId) {
+    AnnounceParams params{"-pt0001-0123456789ab", 6881};
+    params.event = AnnounceParams::Started;
+    params.numwant = 30;
+
+    optional<TrackerResponse> response;
+    tracker->announce(params, [&](auto result) { response = std::move(result); });
+    ASSERT_TRUE(context.run_until([&] { return response.has_value(); }));
+    EXPECT_EQ(response->interval(), 1800u);
+    ASSERT_EQ(response->peers().size(), 2u);
+    EXPECT_EQ(response->peers()[0], Address(0x0a000001, 6881));
+    EXPECT_EQ(stand_in.last_event, static_cast<uint32_t>(AnnounceParams::Started));
+    EXPECT_EQ(stand_in.last_numwant, 30u);
+
+    // the connection ID is still fresh, so the second announce goes straight out
+    response.reset();
+    params.event = AnnounceParams::None;
+    tracker->announce(params, [&](auto result) { response = std::move(result); });
+    ASSERT_TRUE(context.run_until([&] { return response.has_value(); }));
+    EXPECT_EQ(stand_in.connects, 1u);
+    EXPECT_EQ(stand_in.announces, 2u);
+    EXPECT_EQ(stand_in.last_event, 0u);
+}
+
+TEST_F(UdpTrackerTest, ScrapeBatchesHashes) {
+    // more than fit in one packet
+    for (uint32_t i = 0; i < 100; ++i) {
+        stand_in.hashes.push_back(Hash::of(std::to_string(i)));
+    }
+
+    bool done = false;
+    optional<vector<ScrapeInfo>> result;
+    tracker->scrape(stand_in.hashes, [&](auto info) {
+        result = std::move(info);
+        done = true;
+    });
+    ASSERT_TRUE(context.run_until([&] { return done; }));
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(stand_in.scrape_sizes, (vector<size_t>{74, 26}));
+    ASSERT_EQ(result->size(), 100u);
+    for (uint32_t i = 0; i < 100; ++i) {
+        EXPECT_EQ((*result)[i].seeders, i);
+        EXPECT_EQ((*result)[i].completed, 2 * i);
+        EXPECT_EQ((*result)[i].leechers, i + 1);
+    }
+    EXPECT_EQ(stand_in.connects, 1u);
+}
@@ -0,0 +1,162 @@
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include <webseed.hpp>
+
+#include "support.hpp"
+
+// a stand-in HTTP server on loopback holding one file. it answers Range requests with 206 over a keep-alive
+// connection, unless told to misbehave by declaring a body far bigger than anything it was asked for
+class StandInServer {
+public:
+    StandInServer(ba::io_context& io, string data)
+        : acceptor_(io, tcp::endpoint{ba::ip::address_v4::loopback(), 0}), socket_(io), data_(std::move(data)) {
+        accept();
+    }
+
+    [[nodiscard]] string url() const { return "http://127.0.0.1:" + std::to_string(acceptor_.local_endpoint().port()); }
+
+    bool oversized = false;
+
+    uint32_t connections = 0;
+    vector<std::pair<uint64_t, uint64_t>> ranges;
+    // the client hung up on us
+    bool closed = false;
+
+private:
+    tcp::acceptor acceptor_;
+    tcp::socket socket_;
+    const string data_;
+    string request_;
+    string response_;
+
+    void accept() {
+        acceptor_.async_accept(socket_, [this](auto ec) {
+            if (ec) return;
+            ++connections;
+            closed = false;
+            request_.clear();
+            read();
+        });
+    }
+
+    void read() {
+        ba::async_read_until(socket_, ba::dynamic_buffer(request_), "\r\n\r\n", [this](auto ec, auto length) {
+            if (ec) {
+                closed = true;
+                socket_.close();
+                accept();
+                return;
+            }
+            const auto headers = request_.substr(0, length);
+            request_.erase(0, length);
+            respond(headers);
+        });
+    }
+
+    void respond(const string& headers) {
+        const auto range = headers.find("Range: bytes=");
+        ASSERT_NE(range, string::npos);
+        const auto dash = headers.find('-', range);
+        const auto first = std::stoull(headers.substr(range + 13, dash - range - 13));
+        const auto last = std::stoull(headers.substr(dash + 1));
+        ranges.emplace_back(first, last);
+
+        response_ = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-"
+                    + std::to_string(last) + "/" + std::to_string(data_.size()) + "\r\n";
+        if (oversized) {
+            response_ += "Content-Length: " + std::to_string(data_.size() + 1) + "\r\n\r\n";
+        } else {
+            response_ += "Content-Length: " + std::to_string(last - first + 1) + "\r\n\r\n";
+            response_ += data_.substr(first, last - first + 1);
+        }
+        ba::async_write(socket_, ba::buffer(response_), [this](auto ec, auto) {
+            if (!ec) read();
+        });
+    }
+};
+
+class WebSeedTest: public ::testing::Test {
+protected:
+    static constexpr uint32_t PIECE_LENGTH = 16 * 1024;
+
+    // five pieces, the last one short
+    WebSeedTest()
+        : data(contents(4 * PIECE_LENGTH + 1000)), test(make_torrent("webseed.bin", data, PIECE_LENGTH)),
+          server(test.io, data) {}
+
+    ~WebSeedTest() override {
+        Result result;
+        while (test.result_queue->pop(result)) {
+            if (auto complete = std::get_if<ResultPieceComplete>(&result)) complete->piece.free();
+        }
+    }
+
+    static string contents(size_t length) {
+        string data(length, 0);
+        for (size_t i = 0; i < length; ++i) data[i] = static_cast<char>(i * 7 + i / 1000);
+        return data;
+    }
+
+    // the pieces that have come through so far, checked against the file
+    void collect() {
+        Result result;
+        while (test.result_queue->pop(result)) {
+            auto complete = std::get_if<ResultPieceComplete>(&result);
+            ASSERT_NE(complete, nullptr);
+            const auto& piece = complete->piece;
+            EXPECT_EQ(string(piece.data(), piece.size()), data.substr(piece.index() * PIECE_LENGTH, piece.size()));
+            completed.insert(piece.index());
+            complete->piece.free();
+        }
+    }
+
+    const string data;
+    TestContext test;
+    StandInServer server;
+    std::set<uint32_t> completed;
+};
+
+TEST_F(WebSeedTest, FetchesEveryPieceByRange) {
+    auto seed = WebSeed::create(test.ctx, server.url());
+    ASSERT_NE(seed, nullptr);
+    seed->start();
+
+    ASSERT_TRUE(test.run_until([&] {
+        collect();
+        return completed.size() == test.tor.pieces();
+    }));
+    // one keep-alive connection. the first request is a single piece, before there's a rate to size runs by; after
+    // that, runs of whole pieces that between them ask for each byte once
+    EXPECT_EQ(server.connections, 1u);
+    ASSERT_FALSE(server.ranges.empty());
+    const auto [first, last] = server.ranges[0];
+    EXPECT_EQ(last - first + 1, test.tor.piece_size(first / PIECE_LENGTH));
+    uint64_t requested = 0;
+    for (const auto& [begin, end] : server.ranges) {
+        EXPECT_EQ(begin % PIECE_LENGTH, 0u);
+        requested += end - begin + 1;
+    }
+    EXPECT_EQ(requested, data.size());
+}
+
+TEST_F(WebSeedTest, RejectsOversizedBody) {
+    server.oversized = true;
+    auto seed = WebSeed::create(test.ctx, server.url());
+    ASSERT_NE(seed, nullptr);
+    seed->start();
+
+    // the declared length is more than the whole file, so we hang up rather than buffer it, and the piece goes back
+    ASSERT_TRUE(test.run_until([&] { return server.closed; }));
+    collect();
+    EXPECT_TRUE(completed.empty());
+    EXPECT_EQ(test.picker->remaining(), test.tor.pieces());
+}
+
+TEST(WebSeedCreateTest, OnlySpeaksHttp) {
+    TestContext test(make_torrent("webseed.bin", string(1024, 'x'), 1024));
+    EXPECT_EQ(WebSeed::create(test.ctx, "https://example.com/webseed.bin"), nullptr);
+    EXPECT_EQ(WebSeed::create(test.ctx, "ftp://example.com/webseed.bin"), nullptr);
+    EXPECT_NE(WebSeed::create(test.ctx, "http://example.com/webseed.bin"), nullptr);
+}